@@ -22,6 +22,6 @@ unix: mac {
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 # Input
-HEADERS += mainwindow.h capture_thread.h utilities.h
-SOURCES += main.cpp mainwindow.cpp capture_thread.cpp utilities.cpp
+HEADERS += mainwindow.h capture_thread.h utilities.h video_writer_thread.h motion_detector.h motion_benchmark.h analysis_scheduler.h pipeline_stats.h event_index.h clip_viewer.h saved_video_model.h motion_zones.h headless_service.h
+SOURCES += main.cpp mainwindow.cpp capture_thread.cpp utilities.cpp video_writer_thread.cpp motion_detector.cpp motion_benchmark.cpp analysis_scheduler.cpp pipeline_stats.cpp event_index.cpp clip_viewer.cpp saved_video_model.cpp motion_zones.cpp headless_service.cpp
 
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <cmath>
+
+#include "analysis_scheduler.h"
+
+AnalysisScheduler::AnalysisScheduler(int max_interval, double budget_ms) : max_interval(max_interval), budget_ms(budget_ms)
+{
+    reset();
+}
+
+void AnalysisScheduler::reset()
+{
+    current_interval = 1;
+    frames_since_analysis = 0;
+    avg_cost_ms = 0.0;
+}
+
+bool AnalysisScheduler::shouldAnalyze()
+{
+    frames_since_analysis++;
+    if (frames_since_analysis >= current_interval)
+    {
+        frames_since_analysis = 0;
+        return true;
+    }
+    return false;
+}
+
+void AnalysisScheduler::analyzed(double cost_ms, bool has_motion)
+{
+    avg_cost_ms = avg_cost_ms == 0.0 ? cost_ms : 0.9 * avg_cost_ms + 0.1 * cost_ms;
+
+    if (has_motion)
+    {
+        // Ramp straight to the fastest rate the budget allows
+        current_interval = budgetInterval();
+    }
+    else
+    {
+        // Back off gradually while the scene stays quiet
+        current_interval = std::min(max_interval, current_interval * 2);
+        current_interval = std::max(current_interval, budgetInterval());
+    }
+}
+
+// The smallest interval that keeps the average cost per captured frame within budget
+int AnalysisScheduler::budgetInterval() const
+{
+    if (budget_ms <= 0.0)
+    {
+        return 1;
+    }
+    // The budget wins over max_interval, a host that is out of CPU must skip more
+    return std::max(1, (int)std::ceil(avg_cost_ms / budget_ms));
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * Decides which captured frames get motion analysis. While the scene is quiet
+ * only every k-th frame is analyzed, once motion shows up every frame is. On
+ * top of that the interval never drops below what the CPU budget allows, so
+ * the average analysis cost per captured frame stays within budget_ms.
+ */
+class AnalysisScheduler
+{
+public:
+    AnalysisScheduler(int max_interval = 8, double budget_ms = 10.0);
+
+    void setMaxInterval(int k) { max_interval = k > 0 ? k : 1; };
+    void setBudget(double ms) { budget_ms = ms; };
+    void reset();
+
+    // Called once per captured frame
+    bool shouldAnalyze();
+    // Report the cost of an analysis and whether it found motion
+    void analyzed(double cost_ms, bool has_motion);
+
+    int interval() const { return current_interval; };
+    double averageCost() const { return avg_cost_ms; };
+
+private:
+    int budgetInterval() const;
+
+    int max_interval;
+    double budget_ms;
+
+    int current_interval;
+    int frames_since_analysis;
+    double avg_cost_ms; // exponential moving average of the analysis cost
+};
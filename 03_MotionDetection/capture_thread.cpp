@@ -1,4 +1,5 @@
 #include <QTime>
+#include <QElapsedTimer>
 #include <QtConcurrent>
 #include <QDebug>
 
@@ -7,173 +8,425 @@
 
 CaptureThread::CaptureThread(int camera, QMutex *lock) : running(false), cameraID(camera), videoPath(""), data_lock(lock)
 {
-    fps_calculating = false;
-    fps = 0.0;
+    frame_timestamp = 0;
 
     frame_width = frame_height = 0;
+    source_fps = 30;
     video_saving_status = STOPPED;
     saved_video_name = "";
     video_writer = nullptr;
+    continuous_recording = false;
+    recording_codec = VideoWriterThread::MJPG_AVI;
+    segment_seconds = 60;
+    storage_budget = 0;
 
     motion_detecting_status = false;
+    motion_detected = false;
+    motion_energy = 0.0;
+    analysis_scale = 1.0;
+    analysis_gray = false;
+    detector = nullptr;
+
+    adaptive_analysis = false;
+    analysis_budget_ms = 10.0;
+
+    source_name = "";
+    preview_scale = 1.0;
+    display_enabled = true;
+    replay_mode = REALTIME;
+    analysis_pool = nullptr;
+    analysis_priority = 0;
+    analysis_in_flight = 0;
+    analysis_ready = false;
+    analysis_has_motion = false;
+    analysis_cost_ms = 0.0;
+    analysis_energy = 0.0;
+    zones_changed = false;
 }
 
 CaptureThread::CaptureThread(QString videoPath, QMutex *lock) : running(false), cameraID(-1), videoPath(videoPath), data_lock(lock)
 {
-    fps_calculating = false;
-    fps = 0.0;
+    frame_timestamp = 0;
 
     frame_width = frame_height = 0;
+    source_fps = 30;
     video_saving_status = STOPPED;
     saved_video_name = "";
     video_writer = nullptr;
+    continuous_recording = false;
+    recording_codec = VideoWriterThread::MJPG_AVI;
+    segment_seconds = 60;
+    storage_budget = 0;
 
     motion_detecting_status = false;
+    motion_detected = false;
+    motion_energy = 0.0;
+    analysis_scale = 1.0;
+    analysis_gray = false;
+    detector = nullptr;
+
+    adaptive_analysis = false;
+    analysis_budget_ms = 10.0;
+
+    source_name = "";
+    preview_scale = 1.0;
+    display_enabled = true;
+    replay_mode = REALTIME;
+    analysis_pool = nullptr;
+    analysis_priority = 0;
+    analysis_in_flight = 0;
+    analysis_ready = false;
+    analysis_has_motion = false;
+    analysis_cost_ms = 0.0;
+    analysis_energy = 0.0;
+    zones_changed = false;
 }
 
 // Main loop for capturing and processing video frames
 void CaptureThread::run()
 {
     running = true;
-    cv::VideoCapture cap(cameraID);
-    // cv::VideoCapture cap("path/to/video/file");
+    cv::VideoCapture cap;
+    if (videoPath.isEmpty())
+    {
+        cap.open(cameraID);
+    }
+    else
+    {
+        cap.open(videoPath.toStdString());
+    }
+    if (!cap.isOpened())
+    {
+        qWarning() << "Error opening source" << (videoPath.isEmpty() ? QString::number(cameraID) : videoPath);
+        running = false;
+        return;
+    }
     cv::Mat tmp_frame;
 
+    // An MJPEG camera can hand over its JPEG frames undecoded. They are recorded
+    // as they are and only decoded here for analysis and display.
+    bool passthrough = false;
+    cv::Mat encoded_frame;
+    if (videoPath.isEmpty() && recording_codec == VideoWriterThread::PASSTHROUGH)
+    {
+        int mjpg = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+        cap.set(cv::CAP_PROP_FOURCC, mjpg);
+        passthrough = (int)cap.get(cv::CAP_PROP_FOURCC) == mjpg && cap.set(cv::CAP_PROP_FORMAT, -1);
+        if (!passthrough)
+        {
+            qDebug() << "camera doesn't deliver MJPEG, passthrough recordings are encoded by the writer";
+        }
+    }
+
     // Update video frame dimensions
     frame_width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
     frame_height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
 
     // Initialize a background subtractor for motion detection
-    segmentor = cv::createBackgroundSubtractorMOG2(500, 16, true);
+    detector = new MotionDetector(analysis_scale, analysis_gray);
+    scheduler.reset();
+
+    // Start the writer thread, recordings are encoded and written there
+    video_writer = new VideoWriterThread();
+    connect(video_writer, &VideoWriterThread::videoSaved, this, &CaptureThread::videoSaved);
+    connect(video_writer, &VideoWriterThread::statsChanged, this, &CaptureThread::writerStatsChanged);
+    video_writer->start();
+
+    // Video files are paced to their own frame rate unless replayed as fast as possible,
+    // cameras and network streams deliver frames at their own pace
+    bool paced = isFileSource() && replay_mode == REALTIME;
+    bool deterministic = isFileSource() && replay_mode == FAST;
+    source_fps = cap.get(cv::CAP_PROP_FPS);
+    if (source_fps <= 0)
+    {
+        source_fps = 30;
+    }
+    QElapsedTimer replay_clock;
+    replay_clock.start();
+    int frame_count = 0;
+    bool segments_started = false;
+    qint64 last_stats_emit = PipelineStats::now();
 
     while (running)
     {
-        cap >> tmp_frame;
-        if (tmp_frame.empty())
+        qint64 grab_start = PipelineStats::now();
+        if (passthrough)
+        {
+            cap >> encoded_frame;
+            if (!encoded_frame.empty() && cv::imdecode(encoded_frame, cv::IMREAD_COLOR, &tmp_frame).empty())
+            {
+                // Not JPEG after all, let the backend convert frames again
+                qWarning() << "raw camera frames are not JPEG, passthrough disabled";
+                passthrough = false;
+                encoded_frame.release();
+                cap.set(cv::CAP_PROP_CONVERT_RGB, 1);
+                continue;
+            }
+        }
+        else
+        {
+            cap >> tmp_frame;
+        }
+        if (tmp_frame.empty() || (passthrough && encoded_frame.empty()))
         {
             break;
         }
+        qint64 grabbed = PipelineStats::now();
+        stats.addLatency(PipelineStats::GRAB, grabbed - grab_start);
+
+        frame_count++;
+        if (paced)
+        {
+            qint64 ahead_ms = (qint64)(frame_count * 1000.0 / source_fps) - replay_clock.elapsed();
+            if (ahead_ms > 0)
+            {
+                msleep(ahead_ms);
+                grabbed = PipelineStats::now();
+            }
+        }
+        stats.addEvent(PipelineStats::CAPTURED, grabbed);
+
         if (motion_detecting_status)
         {
-            motionDetect(tmp_frame);
+            // With a shared pool the detector is busy until the previous analysis has finished
+            bool analysis_idle = deterministic || analysis_pool == nullptr || analysis_in_flight.loadAcquire() == 0;
+            applyAnalysisResult();
+
+            if (analysis_idle)
+            {
+                // Pick up analysis settings changed from the GUI thread
+                detector->setAnalysisScale(analysis_scale);
+                detector->setGrayscale(analysis_gray);
+                scheduler.setBudget(analysis_budget_ms);
+                applyZones();
+            }
+
+            // A fast replay analyzes every frame inline, so results don't depend on timing
+            if (deterministic)
+            {
+                motionDetect(tmp_frame, false);
+            }
+            else if (analysis_idle && (!adaptive_analysis || scheduler.shouldAnalyze()))
+            {
+                motionDetect(tmp_frame, analysis_pool != nullptr);
+            }
+
+            // Skipped frames keep showing the boxes of the last analysis
+            drawMotion(tmp_frame);
         }
-        if (video_saving_status == STARTING)
+        if (continuous_recording != segments_started)
         {
-            startSavingVideo(tmp_frame);
+            if (continuous_recording)
+            {
+                video_writer->setStorageBudget(storage_budget);
+                video_writer->setCodec(recording_codec);
+                video_writer->startSegments(source_name, recordingFps(), cv::Size(frame_width, frame_height), segment_seconds);
+            }
+            else
+            {
+                video_writer->stopVideo();
+            }
+            segments_started = continuous_recording;
+            // An event in progress goes on as a marker, or as a clip of its own when segments stop
+            bool event_running = video_saving_status == STARTING || video_saving_status == STARTED;
+            video_saving_status = event_running ? STARTING : STOPPED;
         }
-        if (video_saving_status == STARTED)
+        if (segments_started)
         {
-            video_writer->write(tmp_frame);
+            // Motion and the record button only place markers into the running segment
+            if (video_saving_status == STARTING)
+            {
+                video_writer->startMarker(Utilities::newSavedVideoName(source_name), tmp_frame);
+                video_saving_status = STARTED;
+            }
+            writeFrame(tmp_frame, deterministic, encoded_frame);
+            if (video_saving_status == STOPPING)
+            {
+                video_writer->stopMarker();
+                video_saving_status = STOPPED;
+            }
         }
-        if (video_saving_status == STOPPING)
+        else
         {
-            stopSavingVideo();
+            if (video_saving_status == STARTING)
+            {
+                startSavingVideo(tmp_frame);
+            }
+            if (video_saving_status == STARTED)
+            {
+                writeFrame(tmp_frame, deterministic, encoded_frame);
+            }
+            if (video_saving_status == STOPPING)
+            {
+                stopSavingVideo();
+            }
         }
 
-        // Convert frame color from BGR to RGB
-        cvtColor(tmp_frame, tmp_frame, cv::COLOR_BGR2RGB);
-
-        // Thead-safe update
-        data_lock->lock();
-        frame = tmp_frame;
-        data_lock->unlock();
+        // Downscale for display if requested, then convert frame color from BGR to RGB.
+        // Without a display (headless) none of this is needed.
+        qint64 prep_start = PipelineStats::now();
+        if (display_enabled)
+        {
+            cv::Mat display_frame = tmp_frame;
+            if (preview_scale < 1.0)
+            {
+                cv::resize(tmp_frame, display_frame, cv::Size(), preview_scale, preview_scale, cv::INTER_AREA);
+            }
+            if (motion_detecting_status)
+            {
+                drawZones(display_frame);
+            }
+            cvtColor(display_frame, display_frame, cv::COLOR_BGR2RGB);
+
+            // Thead-safe update
+            data_lock->lock();
+            frame = display_frame;
+            frame_timestamp = grabbed;
+            data_lock->unlock();
+
+            // Emit a signal indicating a new frame has been captured
+            emit frameCaptured(&frame);
+        }
 
-        // Emit a signal indicating a new frame has been captured
-        emit frameCaptured(&frame);
-        if (fps_calculating)
+        qint64 prep_end = PipelineStats::now();
+        stats.addLatency(PipelineStats::DISPLAY_PREP, prep_end - prep_start);
+        if (prep_end - last_stats_emit >= 1000000)
         {
-            calculateFPS(cap);
+            last_stats_emit = prep_end;
+            if (stats.enabled())
+            {
+                emit statsChanged(stats.summary());
+            }
+            if (motion_detecting_status && !zone_energy.empty())
+            {
+                emit zoneEnergyChanged(QVector<double>(zone_energy.begin(), zone_energy.end()));
+            }
         }
     }
 
-    // Cleanup
+    if (!videoPath.isEmpty())
+    {
+        double elapsed_s = replay_clock.elapsed() / 1000.0;
+        qDebug() << "replayed" << frame_count << "frames of" << videoPath << "in" << elapsed_s << "s,"
+                 << (elapsed_s > 0 ? frame_count / elapsed_s : 0.0) << "fps";
+    }
+
+    // Cleanup, the writer finishes queued frames and closes any open recording
     cap.release();
+    while (analysis_in_flight.loadAcquire() != 0)
+    {
+        QThread::msleep(1);
+    }
+    video_writer->stop();
+    video_writer->wait();
+    delete video_writer;
+    video_writer = nullptr;
+    video_saving_status = STOPPED;
+    delete detector;
+    detector = nullptr;
     running = false;
 }
 
-/*
- * Calculate the FPS by reading 100 frames from the video capture device, then
- * divide the number of frames by the elapsed time in seconds.
- */
-void CaptureThread::calculateFPS(cv::VideoCapture &cap)
+// The cover and the video file are written by the writer thread, see VideoWriterThread
+void CaptureThread::startSavingVideo(cv::Mat &firstFrame)
 {
-    const int count_to_read = 100;
-    cv::Mat tmp_frame;
-    QTime timer;
-    timer.start();
-    for (int i = 0; i < count_to_read; i++)
+    saved_video_name = Utilities::newSavedVideoName(source_name);
+    video_writer->setCodec(recording_codec);
+    video_writer->startVideo(saved_video_name, firstFrame, recordingFps(), cv::Size(frame_width, frame_height));
+    video_saving_status = STARTED;
+}
+
+// Files are recorded at their own frame rate, a fast replay decodes them much faster.
+// Cameras and streams are recorded at the rate frames actually arrive
+double CaptureThread::recordingFps()
+{
+    double fps = stats.rate(PipelineStats::CAPTURED);
+    if (isFileSource() || fps <= 0)
     {
-        cap >> tmp_frame;
+        return source_fps;
     }
-    int elapsed_ms = timer.elapsed();
-    fps = count_to_read / (elapsed_ms / 1000.0);
-    fps_calculating = false;
-
-    // Emit a signal to inform about the updated FPS
-    emit fpsChanged(fps);
+    return fps;
 }
 
-void CaptureThread::startSavingVideo(cv::Mat &firstFrame)
+// Hand a frame to the writer together with its motion summary for the event index
+void CaptureThread::writeFrame(cv::Mat &frame, bool wait_if_full, const cv::Mat &encoded)
 {
-    saved_video_name = Utilities::newSavedVideoName();
-
-    QString cover = Utilities::getSavedVideoPath(saved_video_name, "jpg");
-    cv::imwrite(cover.toStdString(), firstFrame);
-
-    video_writer = new cv::VideoWriter(
-        Utilities::getSavedVideoPath(saved_video_name, "avi").toStdString(),
-        cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
-        fps ? fps : 30,
-        cv::Size(frame_width, frame_height));
-    video_saving_status = STARTED;
+    cv::Rect motion;
+    for (size_t i = 0; i < motion_boxes.size(); i++)
+    {
+        motion |= motion_boxes[i];
+    }
+    video_writer->writeFrame(frame, wait_if_full, motion_detecting_status ? motion_energy : 0.0, motion, encoded);
 }
 
+// videoSaved is emitted by the writer thread once the file is closed
 void CaptureThread::stopSavingVideo()
 {
     video_saving_status = STOPPED;
-    video_writer->release();
-    delete video_writer;
-    video_writer = nullptr;
-    emit videoSaved(saved_video_name);
+    video_writer->stopVideo();
 }
 
-void CaptureThread::motionDetect(cv::Mat &frame)
+void CaptureThread::motionDetect(cv::Mat &frame, bool use_pool)
 {
-    // Create an empty matrix to store the foreground mask (result of background subtraction)
-    cv::Mat fgmask;
-    
-    // Apply the background subtraction method on the given frame. The result is stored in fgmask.
-    segmentor->apply(frame, fgmask);
-
-    // If fgmask is empty (no foreground detected), exit the function
-    if (fgmask.empty())
+    // Background subtraction and morphology run at the analysis resolution,
+    // the bounding boxes come back in full-resolution coordinates.
+    if (!use_pool)
     {
+        int64 t0 = cv::getTickCount();
+        bool has_motion = detector->detect(frame, motion_boxes);
+        motion_energy = detector->motionEnergy();
+        zone_energy = detector->zoneEnergy();
+        double cost_ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+        updateMotionStatus(has_motion, cost_ms);
         return;
     }
 
-    // Threshold the foreground mask. All pixel values below 25 become 0 (black)
-    // and values above become 255 (white).
-    cv::threshold(fgmask, fgmask, 25, 255, cv::THRESH_BINARY);
-
-    // Define the size for the structuring element, which is used for morphological operations. The name "noise_size" can be misleading. Here it is used to remove noise in the foreground mask.
-    int noise_size = 9;
-
-    // Create a rectangular structuring element.
-    // cv::MORPH_RECT results in a matrix filled with ones, just like creating a cv::Mat of ones manually. We use cv::getStructuringElement() here for clarity.
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(noise_size, noise_size));
+    // Hand a copy to the shared pool, a later iteration picks up the result
+    analysis_in_flight.storeRelease(1);
+    cv::Mat analysis_frame = frame.clone();
+    analysis_pool->start([this, analysis_frame]()
+                         { runAnalysis(analysis_frame); },
+                         analysis_priority);
+}
 
-    // Erode the image to reduce speckles and small blobs
-    cv::erode(fgmask, fgmask, kernel);
-    
-    // Dilate the image to consolidate white regions and fill small holes
-    cv::dilate(fgmask, fgmask, kernel, cv::Point(-1, -1), 3);
+// Runs on a pool thread
+void CaptureThread::runAnalysis(cv::Mat frame)
+{
+    int64 t0 = cv::getTickCount();
+    vector<cv::Rect> boxes;
+    bool has_motion = detector->detect(frame, boxes);
+    double cost_ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+
+    analysis_lock.lock();
+    analysis_boxes = boxes;
+    analysis_has_motion = has_motion;
+    analysis_cost_ms = cost_ms;
+    analysis_energy = detector->motionEnergy();
+    analysis_zone_energy = detector->zoneEnergy();
+    analysis_ready = true;
+    analysis_lock.unlock();
+    analysis_in_flight.storeRelease(0);
+}
 
-    // Find contours in the foreground mask. These contours represent potential motion regions.
-    vector<vector<cv::Point>> contours;
-    cv::findContours(fgmask, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+void CaptureThread::applyAnalysisResult()
+{
+    QMutexLocker locker(&analysis_lock);
+    if (!analysis_ready)
+    {
+        return;
+    }
+    analysis_ready = false;
+    motion_boxes = analysis_boxes;
+    motion_energy = analysis_energy;
+    zone_energy = analysis_zone_energy;
+    updateMotionStatus(analysis_has_motion, analysis_cost_ms);
+}
 
-    // If there are contours, it indicates motion
-    bool has_motion = contours.size() > 0;
+void CaptureThread::updateMotionStatus(bool has_motion, double cost_ms)
+{
+    scheduler.analyzed(cost_ms, has_motion);
+    stats.addLatency(PipelineStats::ANALYSIS, (qint64)(cost_ms * 1000));
+    stats.addEvent(PipelineStats::PROCESSED, PipelineStats::now());
 
     // If motion is newly detected, start saving the video and send a notification
     if (!motion_detected && has_motion)
@@ -189,29 +442,61 @@ void CaptureThread::motionDetect(cv::Mat &frame)
         setVideoSavingStatus(STOPPING);
         qDebug() << "detected motion disappeared.";
     }
+}
+
+// Called from the GUI thread, the detector picks the zones up once it is idle
+void CaptureThread::setZones(const vector<MotionZone> &zones)
+{
+    QMutexLocker locker(&analysis_lock);
+    pending_zones = zones;
+    zones_changed = true;
+}
+
+void CaptureThread::applyZones()
+{
+    QMutexLocker locker(&analysis_lock);
+    if (!zones_changed)
+    {
+        return;
+    }
+    zones_changed = false;
+    active_zones = pending_zones;
+    detector->setZones(active_zones);
+    zone_energy.clear();
+}
 
+void CaptureThread::drawMotion(cv::Mat &frame)
+{
     // Set the color for drawing contours (red in this case)
-    cv::Scalar color = cv::Scalar(0, 0, 255); 
+    cv::Scalar color = cv::Scalar(0, 0, 255);
 
-    // Iterate through detected contours and draw rectangles around them on the original frame
-    for (size_t i = 0; i < contours.size(); i++)
+    // Draw rectangles around the detected motion regions on the original frame
+    for (size_t i = 0; i < motion_boxes.size(); i++)
     {
-        cv::Rect rect = cv::boundingRect(contours[i]);
-        cv::rectangle(frame, rect, color, 1);
-        // The following line can be used to draw the contours directly, instead of rectangles
-        // cv::drawContours(frame, contours, (int)i, color, 1);
+        cv::rectangle(frame, motion_boxes[i], color, 1);
     }
 }
 
-// Setters for thread controls and video capture configurations
-void CaptureThread::setRunning(bool run)
+// Only the display gets the outlines, recordings show the scene as the camera saw it
+void CaptureThread::drawZones(cv::Mat &frame)
 {
-    running = run;
+    // Outline the zones, include zones in green and exclude zones in gray
+    for (size_t i = 0; i < active_zones.size(); i++)
+    {
+        vector<cv::Point> polygon;
+        for (size_t j = 0; j < active_zones[i].polygon.size(); j++)
+        {
+            polygon.push_back(cv::Point(cvRound(active_zones[i].polygon[j].x * frame.cols), cvRound(active_zones[i].polygon[j].y * frame.rows)));
+        }
+        cv::Scalar zone_color = active_zones[i].include ? cv::Scalar(0, 255, 0) : cv::Scalar(128, 128, 128);
+        cv::polylines(frame, vector<vector<cv::Point>>{polygon}, true, zone_color, 1);
+    }
 }
 
-void CaptureThread::startCalcFPS()
+// Setters for thread controls and video capture configurations
+void CaptureThread::setRunning(bool run)
 {
-    fps_calculating = true;
+    running = run;
 }
 
 void CaptureThread::setVideoSavingStatus(VideoSavingStatus status)
@@ -3,10 +3,18 @@
 #include <QString>
 #include <QThread>
 #include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QVector>
 #include "opencv2/opencv.hpp"
 #include "opencv2/videoio.hpp"
 #include "opencv2/video/background_segm.hpp"
 
+#include "analysis_scheduler.h"
+#include "motion_detector.h"
+#include "pipeline_stats.h"
+#include "video_writer_thread.h"
+
 using namespace std;
 
 class CaptureThread : public QThread
@@ -22,7 +30,22 @@ public:
 
     // Setters for thread controls and video capture configurations
     void setRunning(bool run);
-    void startCalcFPS();
+
+    // Rolling frame rates and stage latencies, statsChanged is emitted once per second while enabled
+    void setStatsEnabled(bool on) { stats.setEnabled(on); };
+    PipelineStats *pipelineStats() { return &stats; };
+    qint64 frameTimestamp() const { return frame_timestamp; }; // read under the data lock
+
+    // Pacing of video file sources: REALTIME plays them at their own frame rate,
+    // FAST decodes as fast as possible and analyzes every frame, for offline
+    // throughput testing with deterministic results
+    enum ReplayMode
+    {
+        REALTIME,
+        FAST
+    };
+    void setReplayMode(ReplayMode mode) { replay_mode = mode; };
+    bool isFileSource() const { return !videoPath.isEmpty() && !videoPath.contains("://"); };
 
     // Enumeration to handle video saving status
     enum VideoSavingStatus
@@ -36,40 +59,120 @@ public:
     void setVideoSavingStatus(VideoSavingStatus status);
     void setMotionDetectingStatus(bool status);
 
+    // Motion analysis runs on a copy of the frame downscaled by this factor
+    void setAnalysisScale(double scale) { analysis_scale = scale; };
+    void setAnalysisGrayscale(bool gray) { analysis_gray = gray; };
+    // Include/exclude zones, see MotionZones for the file format
+    void setZones(const vector<MotionZone> &zones);
+
+    // Skip analysis of frames while the scene is quiet or the CPU budget is exceeded
+    void setAdaptiveAnalysis(bool adaptive) { adaptive_analysis = adaptive; };
+    void setAnalysisBudget(double ms_per_frame) { analysis_budget_ms = ms_per_frame; };
+
+    // Run motion analysis on a pool shared with other sources instead of this thread,
+    // sources with a higher priority get their analysis scheduled first
+    void setAnalysisPool(QThreadPool *pool, int priority = 0)
+    {
+        analysis_pool = pool;
+        analysis_priority = priority;
+    };
+
+    // Displayed frames are downscaled by this factor, e.g. for grid tiles
+    void setPreviewScale(double scale) { preview_scale = scale; };
+    // Without a display no frames are converted or emitted
+    void setDisplayEnabled(bool on) { display_enabled = on; };
+    // Tag for saved videos so that concurrent sources don't collide
+    void setSourceName(QString name) { source_name = name; };
+    QString sourceName() const { return source_name; };
+    QString sourceDescription() const { return videoPath.isEmpty() ? QString::number(cameraID) : videoPath; };
+    bool motionDetected() const { return motion_detected; };
+
+    // Record all the time into fixed-length segments, motion only places markers.
+    // Segment length and storage budget are picked up when continuous recording starts.
+    void setContinuousRecording(bool on) { continuous_recording = on; };
+    void setSegmentLength(int seconds) { segment_seconds = seconds; };
+    void setStorageBudget(qint64 bytes) { storage_budget = bytes; };
+
+    // Format of new recordings, passthrough of camera JPEGs is set up when the capture starts
+    void setRecordingCodec(VideoWriterThread::Codec codec) { recording_codec = codec; };
+
 protected:
     void run() override; // Main loop for capturing and processing video frames
 
 signals:
-    // Signals to notify other Qt components about frame capture, FPS changes, and video saving status
+    // Signals to notify other Qt components about frame capture, pipeline statistics, and video saving status
     void frameCaptured(cv::Mat *data);
-    void fpsChanged(float fps);
+    void statsChanged(PipelineStats::Summary summary);
     void videoSaved(QString name);
+    void writerStatsChanged(int queue_depth, int dropped_frames, double avg_write_ms);
+    void zoneEnergyChanged(QVector<double> energy); // once per second while monitoring with zones
 
 private:
-    // Internal helper functions for FPS calculation, video saving, and motion detection
-    void calculateFPS(cv::VideoCapture &cap);
+    // Internal helper functions for video saving and motion detection
     void startSavingVideo(cv::Mat &firstFrame);
+    double recordingFps();
     void stopSavingVideo();
-    void motionDetect(cv::Mat &frame);
+    void writeFrame(cv::Mat &frame, bool wait_if_full, const cv::Mat &encoded);
+    void motionDetect(cv::Mat &frame, bool use_pool);
+    void runAnalysis(cv::Mat frame);
+    void applyAnalysisResult();
+    void updateMotionStatus(bool has_motion, double cost_ms);
+    void drawMotion(cv::Mat &frame);
+    void drawZones(cv::Mat &frame);
+    void applyZones();
 
     bool running;
     int cameraID;
     QString videoPath;
     QMutex *data_lock; // Mutex for thread-safe data access
     cv::Mat frame;
+    QString source_name;
+    double preview_scale;
+    bool display_enabled;
+    ReplayMode replay_mode;
 
-    // FPS variables
-    bool fps_calculating;
-    float fps;
+    // Pipeline statistics
+    PipelineStats stats;
+    qint64 frame_timestamp; // when the displayed frame was grabbed
 
     // Video saving variables
     int frame_width, frame_height;
+    double source_fps; // frame rate the source reports, 30 if it doesn't
     VideoSavingStatus video_saving_status;
     QString saved_video_name;
-    cv::VideoWriter *video_writer;
+    VideoWriterThread *video_writer; // Encodes and writes frames off the capture thread
+    bool continuous_recording;
+    VideoWriterThread::Codec recording_codec;
+    int segment_seconds;
+    qint64 storage_budget;
 
     // Motion detection variables
     bool motion_detecting_status;
     bool motion_detected;
-    cv::Ptr<cv::BackgroundSubtractorMOG2> segmentor; // OpenCV's MOG2 background subtractor
+    double analysis_scale;
+    bool analysis_gray;
+    MotionDetector *detector;
+    vector<cv::Rect> motion_boxes; // Boxes of the last analyzed frame
+    double motion_energy;          // and its fraction of foreground pixels
+    vector<double> zone_energy;    // and that of each zone
+    vector<MotionZone> active_zones;
+    vector<MotionZone> pending_zones; // guarded by analysis_lock
+    bool zones_changed;
+
+    // Adaptive analysis rate
+    bool adaptive_analysis;
+    double analysis_budget_ms;
+    AnalysisScheduler scheduler;
+
+    // Analysis on a shared pool, at most one frame of this source is in flight
+    QThreadPool *analysis_pool;
+    int analysis_priority;
+    QAtomicInt analysis_in_flight;
+    QMutex analysis_lock;
+    bool analysis_ready;
+    bool analysis_has_motion;
+    double analysis_cost_ms;
+    double analysis_energy;
+    vector<double> analysis_zone_energy;
+    vector<cv::Rect> analysis_boxes;
 };
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include <QGridLayout>
+#include <QPainter>
+#include <QPixmap>
+#include <QImage>
+#include <QDateTime>
+#include <QFile>
+#include <QDebug>
+
+#include "utilities.h"
+#include "clip_viewer.h"
+
+ClipViewer::ClipViewer(const MotionEvent &event, QWidget *parent) : QDialog(parent), event(event)
+{
+    setWindowTitle(event.name);
+    resize(800, 640);
+
+    QString path = event.videoPath();
+    if (event.container != "mjpeg" && !cap.open(path.toStdString()))
+    {
+        qWarning() << "Can't open" << path;
+    }
+
+    // Clips recorded before the event index existed get an even one-second grid
+    if (this->event.keyframes.isEmpty() && cap.isOpened())
+    {
+        double fps = cap.get(cv::CAP_PROP_FPS);
+        int frames = (int)cap.get(cv::CAP_PROP_FRAME_COUNT);
+        fps = fps > 0 ? fps : 30;
+        for (int i = 0; i * fps < frames; i++)
+        {
+            this->event.keyframes.append((int)(i * fps));
+        }
+        this->event.frames = frames;
+        this->event.fps = fps;
+    }
+
+    QGridLayout *layout = new QGridLayout(this);
+    frameLabel = new QLabel(this);
+    frameLabel->setAlignment(Qt::AlignCenter);
+    frameLabel->setMinimumSize(320, 240);
+    layout->addWidget(frameLabel, 0, 0, 1, 3);
+
+    timelineLabel = new QLabel(this);
+    timelineLabel->setFixedHeight(40);
+    timelineLabel->setScaledContents(true);
+    layout->addWidget(timelineLabel, 1, 0, 1, 3);
+
+    slider = new QSlider(Qt::Horizontal, this);
+    slider->setRange(0, qMax(0, this->event.keyframes.size() - 1));
+    layout->addWidget(slider, 2, 0, 1, 3);
+
+    positionLabel = new QLabel(this);
+    layout->addWidget(positionLabel, 3, 0);
+    peakButton = new QPushButton("Jump to &Peak Motion", this);
+    peakButton->setEnabled(this->event.peakSecond() >= 0);
+    layout->addWidget(peakButton, 3, 2);
+
+    connect(slider, SIGNAL(valueChanged(int)), this, SLOT(seekTo(int)));
+    connect(peakButton, SIGNAL(clicked(bool)), this, SLOT(jumpToPeak()));
+
+    drawTimeline();
+    seekTo(0);
+}
+
+ClipViewer::~ClipViewer()
+{
+    cap.release();
+}
+
+void ClipViewer::seekTo(int second)
+{
+    if ((!cap.isOpened() && event.container != "mjpeg") || second < 0 || second >= event.keyframes.size())
+    {
+        return;
+    }
+
+    cv::Mat mat;
+    if (event.container == "mjpeg" && second < event.offsets.size())
+    {
+        // Passthrough files are concatenated JPEGs and the offsets are exact, decode just that one
+        QFile file(event.videoPath());
+        if (!file.open(QIODevice::ReadOnly) || !file.seek(event.offsets[second]))
+        {
+            return;
+        }
+        qint64 end = second + 1 < event.offsets.size() ? event.offsets[second + 1] : file.size();
+        qint64 length = end > event.offsets[second] ? end - event.offsets[second] : file.size();
+        QByteArray data = file.read(qMin(length, (qint64)16 << 20)); // the decoder stops at the end of the first JPEG
+        mat = cv::imdecode(cv::Mat(1, data.size(), CV_8U, data.data()), cv::IMREAD_COLOR);
+    }
+    else
+    {
+        // Every MJPG frame is a keyframe, so this jumps straight to the frame,
+        // other codecs decode from the preceding keyframe
+        cap.set(cv::CAP_PROP_POS_FRAMES, event.keyframes[second]);
+        cap.read(mat);
+    }
+    if (mat.empty())
+    {
+        return;
+    }
+    cvtColor(mat, mat, cv::COLOR_BGR2RGB);
+    QImage image(mat.data, mat.cols, mat.rows, mat.step, QImage::Format_RGB888);
+    frameLabel->setPixmap(QPixmap::fromImage(image).scaled(frameLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+
+    double energy = second < event.energy.size() ? event.energy[second] : 0.0;
+    QString text = QString("%1 s / %2 s, motion %3%")
+                       .arg(second)
+                       .arg(event.keyframes.size())
+                       .arg(energy * 100, 0, 'f', 1);
+    if (event.start_ms > 0)
+    {
+        text += "  " + QDateTime::fromMSecsSinceEpoch(event.start_ms + second * 1000).toString("HH:mm:ss");
+    }
+    positionLabel->setText(text);
+}
+
+void ClipViewer::jumpToPeak()
+{
+    int peak = event.peakSecond();
+    if (peak >= 0)
+    {
+        slider->setValue(peak);
+    }
+}
+
+// One bar per second, scaled to the peak energy of the clip and stretched to the label
+void ClipViewer::drawTimeline()
+{
+    int width = 800, height = 40;
+    QPixmap timeline(width, height);
+    timeline.fill(Qt::black);
+
+    int seconds = event.keyframes.size();
+    int peak = event.peakSecond();
+    if (seconds > 0 && peak >= 0)
+    {
+        QPainter painter(&timeline);
+        double bar_width = (double)width / seconds;
+        for (int i = 0; i < event.energy.size() && i < seconds; i++)
+        {
+            int bar_height = (int)(height * event.energy[i] / event.energy[peak]);
+            painter.fillRect(QRectF(i * bar_width, height - bar_height, qMax(1.0, bar_width - 1), bar_height), Qt::red);
+        }
+    }
+    timelineLabel->setPixmap(timeline);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QDialog>
+#include <QLabel>
+#include <QSlider>
+#include <QPushButton>
+
+#include "opencv2/opencv.hpp"
+#include "event_index.h"
+
+/*
+ * Scrubs through a recorded clip one second at a time. The motion energy of
+ * every second is drawn as a timeline under the slider, and seeking uses the
+ * frame indices from the event index, so only the frame being shown is decoded.
+ */
+class ClipViewer : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ClipViewer(const MotionEvent &event, QWidget *parent = nullptr);
+    ~ClipViewer();
+
+private slots:
+    void seekTo(int second);
+    void jumpToPeak();
+
+private:
+    void drawTimeline();
+
+    MotionEvent event;
+    cv::VideoCapture cap;
+
+    QLabel *frameLabel;
+    QLabel *timelineLabel;
+    QLabel *positionLabel;
+    QSlider *slider;
+    QPushButton *peakButton;
+};
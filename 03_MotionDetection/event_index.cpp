@@ -0,0 +1,162 @@
+#include <QFile>
+#include <QMutex>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QDebug>
+
+#include "utilities.h"
+#include "event_index.h"
+
+MotionEvent::MotionEvent()
+{
+    segment = "";
+    first_frame = 0;
+    container = "avi";
+    start_ms = end_ms = 0;
+    frames = 0;
+    fps = 0.0;
+}
+
+int MotionEvent::peakSecond() const
+{
+    int peak = -1;
+    for (int i = 0; i < energy.size(); i++)
+    {
+        if (energy[i] > 0.0 && (peak < 0 || energy[i] > energy[peak]))
+        {
+            peak = i;
+        }
+    }
+    return peak;
+}
+
+QString MotionEvent::videoPath() const
+{
+    if (segment.isEmpty())
+    {
+        return Utilities::getSavedVideoPath(name, container);
+    }
+    return Utilities::getSegmentPath(segment, container);
+}
+
+QJsonObject MotionEvent::toJson() const
+{
+    QJsonArray energy_array, keyframe_array, offset_array;
+    for (int i = 0; i < energy.size(); i++)
+    {
+        // three decimals are plenty for a timeline and keep the lines short
+        energy_array.append(qRound(energy[i] * 1000) / 1000.0);
+    }
+    for (int i = 0; i < keyframes.size(); i++)
+    {
+        keyframe_array.append(keyframes[i]);
+    }
+    for (int i = 0; i < offsets.size(); i++)
+    {
+        offset_array.append(offsets[i]);
+    }
+
+    QJsonObject json;
+    json["name"] = name;
+    if (!segment.isEmpty())
+    {
+        json["segment"] = segment;
+        json["first_frame"] = first_frame;
+    }
+    if (container != "avi")
+    {
+        json["container"] = container;
+    }
+    json["start"] = start_ms;
+    json["end"] = end_ms;
+    json["frames"] = frames;
+    json["fps"] = fps;
+    json["bounds"] = QJsonArray({bounds.x(), bounds.y(), bounds.width(), bounds.height()});
+    json["energy"] = energy_array;
+    json["keyframes"] = keyframe_array;
+    json["offsets"] = offset_array;
+    return json;
+}
+
+MotionEvent MotionEvent::fromJson(const QJsonObject &json)
+{
+    MotionEvent event;
+    event.name = json["name"].toString();
+    event.segment = json["segment"].toString();
+    event.first_frame = json["first_frame"].toInt();
+    event.container = json["container"].toString("avi");
+    event.start_ms = (qint64)json["start"].toDouble();
+    event.end_ms = (qint64)json["end"].toDouble();
+    event.frames = json["frames"].toInt();
+    event.fps = json["fps"].toDouble();
+
+    QJsonArray bounds = json["bounds"].toArray();
+    if (bounds.size() == 4)
+    {
+        event.bounds = QRect(bounds[0].toInt(), bounds[1].toInt(), bounds[2].toInt(), bounds[3].toInt());
+    }
+    foreach (const QJsonValue &value, json["energy"].toArray())
+    {
+        event.energy.append(value.toDouble());
+    }
+    foreach (const QJsonValue &value, json["keyframes"].toArray())
+    {
+        event.keyframes.append(value.toInt());
+    }
+    foreach (const QJsonValue &value, json["offsets"].toArray())
+    {
+        event.offsets.append((qint64)value.toDouble());
+    }
+    return event;
+}
+
+QString EventIndex::indexPath()
+{
+    return Utilities::getDataPath() + "/events.jsonl";
+}
+
+bool EventIndex::append(const MotionEvent &event)
+{
+    // several sources have their own writer threads
+    static QMutex append_lock;
+    QMutexLocker locker(&append_lock);
+
+    QFile file(indexPath());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning() << "Can't open the event index" << file.fileName();
+        return false;
+    }
+    QByteArray line = QJsonDocument(event.toJson()).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    bool ok = file.write(line) == line.size();
+    file.close();
+    return ok;
+}
+
+// Events in the order they were recorded
+QList<MotionEvent> EventIndex::load()
+{
+    QList<MotionEvent> events;
+    QFile file(indexPath());
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return events;
+    }
+    while (!file.atEnd())
+    {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty())
+        {
+            continue;
+        }
+        QJsonDocument doc = QJsonDocument::fromJson(line);
+        if (!doc.isObject())
+        {
+            qWarning() << "Skipping a broken line of the event index";
+            continue;
+        }
+        events.append(MotionEvent::fromJson(doc.object()));
+    }
+    return events;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QRect>
+#include <QJsonObject>
+
+/*
+ * One recorded motion event. Timeline data is kept per second of the clip:
+ * the peak motion energy (fraction of foreground pixels) of that second,
+ * the index of its first frame and the approximate byte offset of that frame
+ * in the file. MJPG frames are all keyframes, so seeking to a second is a
+ * single CAP_PROP_POS_FRAMES jump without decoding anything before it.
+ *
+ * With continuous recording the event is a marker into a segment file
+ * instead of a clip of its own, frame indices are then relative to the segment.
+ * Offsets of passthrough (.mjpeg) recordings are exact frame starts.
+ */
+struct MotionEvent
+{
+    QString name;
+    QString segment; // empty for standalone clips
+    int first_frame; // of the event in the segment
+    QString container; // avi, mp4 or mjpeg
+    qint64 start_ms; // milliseconds since epoch
+    qint64 end_ms;
+    int frames;
+    double fps;
+    QRect bounds; // union of all motion boxes
+    QVector<double> energy;
+    QVector<int> keyframes;
+    QVector<qint64> offsets;
+
+    MotionEvent();
+    double duration() const { return (end_ms - start_ms) / 1000.0; };
+    int peakSecond() const; // -1 if no motion energy was recorded
+    QString videoPath() const;
+
+    QJsonObject toJson() const;
+    static MotionEvent fromJson(const QJsonObject &json);
+};
+
+/*
+ * Append-only index of motion events, one JSON object per line in
+ * events.jsonl next to the recordings. Appending never rewrites earlier
+ * entries, and a line left incomplete by a crash is simply skipped on load.
+ */
+class EventIndex
+{
+public:
+    static QString indexPath();
+    static bool append(const MotionEvent &event); // thread-safe, every writer thread may append
+    static QList<MotionEvent> load();
+};
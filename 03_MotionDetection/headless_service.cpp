@@ -0,0 +1,248 @@
+#include <csignal>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QLocalSocket>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QDebug>
+
+#include "utilities.h"
+#include "motion_zones.h"
+#include "headless_service.h"
+
+// Set by SIGINT/SIGTERM, polled by the status timer
+static volatile std::sig_atomic_t quit_requested = 0;
+
+static void requestQuit(int)
+{
+    quit_requested = 1;
+}
+
+HeadlessService::HeadlessService(const Options &options, QObject *parent) : QObject(parent), options(options)
+{
+    analysis_pool = new QThreadPool(this);
+    status_timer = new QTimer(this);
+    server = new QLocalServer(this);
+    started_ms = QDateTime::currentMSecsSinceEpoch();
+}
+
+HeadlessService::~HeadlessService()
+{
+    stop();
+}
+
+bool HeadlessService::start()
+{
+    qRegisterMetaType<PipelineStats::Summary>("PipelineStats::Summary");
+    vector<MotionZone> zones = MotionZones::load(MotionZones::zonesPath());
+
+    for (int i = 0; i < options.sources.size(); i++)
+    {
+        QString source = options.sources[i];
+        QMutex *lock = new QMutex();
+        bool is_camera = false;
+        int camID = source.toInt(&is_camera);
+        CaptureThread *thread = is_camera ? new CaptureThread(camID, lock) : new CaptureThread(source, lock);
+
+        thread->setDisplayEnabled(false);
+        thread->setAnalysisPool(analysis_pool);
+        thread->setAdaptiveAnalysis(true);
+        thread->setMotionDetectingStatus(true);
+        thread->setZones(zones);
+        thread->setContinuousRecording(options.continuous);
+        thread->setReplayMode(options.fast_replay ? CaptureThread::FAST : CaptureThread::REALTIME);
+        if (options.sources.size() > 1)
+        {
+            thread->setSourceName(QString("src%1").arg(i));
+        }
+        connect(thread, &CaptureThread::videoSaved, this, &HeadlessService::videoSaved);
+        connect(thread, &CaptureThread::writerStatsChanged, this, &HeadlessService::writerStatsChanged);
+        connect(thread, &CaptureThread::finished, this, &HeadlessService::sourceFinished);
+
+        sources << thread;
+        source_locks << lock;
+        saved_videos << 0;
+        last_videos << QString();
+        writer_stats << QJsonObject();
+    }
+
+    // A stale socket of a crashed instance would make listen() fail
+    QLocalServer::removeServer(options.socket_name);
+    if (!server->listen(options.socket_name))
+    {
+        qWarning() << "Can't listen on" << options.socket_name << server->errorString();
+    }
+    connect(server, &QLocalServer::newConnection, this, &HeadlessService::sendStatus);
+
+    connect(status_timer, &QTimer::timeout, this, &HeadlessService::writeStatus);
+    status_timer->start(1000);
+
+    foreach (CaptureThread *thread, sources)
+    {
+        thread->start();
+    }
+    qDebug() << "monitoring" << sources.size() << "sources, status in" << Utilities::getDataPath() + "/status.json"
+             << "and on socket" << server->fullServerName();
+    return !sources.isEmpty();
+}
+
+void HeadlessService::stop()
+{
+    status_timer->stop();
+    foreach (CaptureThread *thread, sources)
+    {
+        thread->setRunning(false);
+    }
+    // The threads finish their recordings before they exit
+    foreach (CaptureThread *thread, sources)
+    {
+        thread->wait();
+    }
+    qDeleteAll(sources);
+    qDeleteAll(source_locks);
+    sources.clear();
+    source_locks.clear();
+    server->close();
+}
+
+QJsonObject HeadlessService::status()
+{
+    QJsonArray source_array;
+    for (int i = 0; i < sources.size(); i++)
+    {
+        CaptureThread *thread = sources[i];
+        PipelineStats *stats = thread->pipelineStats();
+
+        QJsonObject json;
+        json["name"] = thread->sourceName();
+        json["source"] = thread->sourceDescription();
+        json["running"] = thread->isRunning();
+        json["motion"] = thread->motionDetected();
+        json["capture_fps"] = stats->rate(PipelineStats::CAPTURED);
+        json["processed_fps"] = stats->rate(PipelineStats::PROCESSED);
+        json["saved_videos"] = saved_videos[i];
+        json["last_video"] = last_videos[i];
+        json["writer"] = writer_stats[i];
+        source_array.append(json);
+    }
+
+    QJsonObject json;
+    json["time"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    json["uptime_s"] = (QDateTime::currentMSecsSinceEpoch() - started_ms) / 1000;
+    json["sources"] = source_array;
+    return json;
+}
+
+// QSaveFile replaces the file atomically, readers never see a half-written status
+void HeadlessService::writeStatus()
+{
+    if (quit_requested)
+    {
+        QCoreApplication::quit();
+        return;
+    }
+
+    QSaveFile file(Utilities::getDataPath() + "/status.json");
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(QJsonDocument(status()).toJson());
+        file.commit();
+    }
+}
+
+void HeadlessService::sendStatus()
+{
+    QByteArray data = QJsonDocument(status()).toJson(QJsonDocument::Compact);
+    while (server->hasPendingConnections())
+    {
+        QLocalSocket *socket = server->nextPendingConnection();
+        connect(socket, &QLocalSocket::disconnected, socket, &QLocalSocket::deleteLater);
+        socket->write(data);
+        socket->write("\n");
+        socket->disconnectFromServer();
+    }
+}
+
+// Video files end on their own, quit once every source is done
+void HeadlessService::sourceFinished()
+{
+    foreach (CaptureThread *thread, sources)
+    {
+        if (!thread->isFinished())
+        {
+            return;
+        }
+    }
+    writeStatus();
+    QCoreApplication::quit();
+}
+
+void HeadlessService::videoSaved(QString name)
+{
+    int i = sources.indexOf(qobject_cast<CaptureThread *>(sender()));
+    if (i < 0)
+    {
+        return;
+    }
+    saved_videos[i]++;
+    last_videos[i] = name;
+    qDebug() << "saved" << name;
+}
+
+void HeadlessService::writerStatsChanged(int queue_depth, int dropped_frames, double avg_write_ms)
+{
+    int i = sources.indexOf(qobject_cast<CaptureThread *>(sender()));
+    if (i < 0)
+    {
+        return;
+    }
+    QJsonObject json;
+    json["queue_depth"] = queue_depth;
+    json["dropped_frames"] = dropped_frames;
+    json["avg_write_ms"] = avg_write_ms;
+    writer_stats[i] = json;
+}
+
+int HeadlessService::run(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    Options options;
+    QStringList args = app.arguments().mid(2);
+    for (int i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--continuous")
+        {
+            options.continuous = true;
+        }
+        else if (args[i] == "--fast")
+        {
+            options.fast_replay = true;
+        }
+        else if (args[i] == "--socket" && i + 1 < args.size())
+        {
+            options.socket_name = args[++i];
+        }
+        else
+        {
+            options.sources << args[i];
+        }
+    }
+    if (options.sources.isEmpty())
+    {
+        qWarning() << "usage: 03_MotionDetection --headless [--continuous] [--fast] [--socket name] source...";
+        return 1;
+    }
+
+    HeadlessService service(options);
+    if (!service.start())
+    {
+        return 1;
+    }
+    std::signal(SIGINT, requestQuit);
+    std::signal(SIGTERM, requestQuit);
+    int result = app.exec();
+    service.stop();
+    return result;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QObject>
+#include <QStringList>
+#include <QList>
+#include <QMutex>
+#include <QTimer>
+#include <QThreadPool>
+#include <QLocalServer>
+#include <QJsonObject>
+
+#include "capture_thread.h"
+
+/*
+ * Runs the capture/analysis/recording pipelines without any GUI, e.g. on a
+ * server with no display. Frames are never converted for display. Status and
+ * metrics are written to status.json in the data directory once per second
+ * and are also served on a local socket; every connection gets the current
+ * status as one JSON document and is closed.
+ */
+class HeadlessService : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options
+    {
+        QStringList sources; // camera indices, video files or stream URLs
+        bool continuous;     // continuous recording instead of one clip per event
+        bool fast_replay;
+        QString socket_name;
+
+        Options() : continuous(false), fast_replay(false), socket_name("opencv-qt-app-03-motion") {}
+    };
+
+    explicit HeadlessService(const Options &options, QObject *parent = nullptr);
+    ~HeadlessService();
+
+    bool start();
+    void stop();
+
+    // --headless [--continuous] [--fast] [--socket name] source...
+    static int run(int argc, char *argv[]);
+
+private slots:
+    void writeStatus();
+    void sendStatus();
+    void sourceFinished();
+    void videoSaved(QString name);
+    void writerStatsChanged(int queue_depth, int dropped_frames, double avg_write_ms);
+
+private:
+    QJsonObject status();
+
+    Options options;
+    QList<CaptureThread *> sources;
+    QList<QMutex *> source_locks;
+    QThreadPool *analysis_pool;
+    QTimer *status_timer;
+    QLocalServer *server;
+    qint64 started_ms;
+
+    // per source, indexed like sources
+    QList<int> saved_videos;
+    QList<QString> last_videos;
+    QList<QJsonObject> writer_stats;
+};
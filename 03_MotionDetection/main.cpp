@@ -1,8 +1,24 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include "mainwindow.h"
+#include "motion_benchmark.h"
+#include "headless_service.h"
 
 int main(int argc, char *argv[])
 {
+    // 03_MotionDetection --benchmark path/to/video compares the analysis scales offline
+    if (argc >= 3 && QString(argv[1]) == "--benchmark")
+    {
+        QCoreApplication app(argc, argv);
+        return MotionBenchmark::run(QString(argv[2]));
+    }
+
+    // 03_MotionDetection --headless [options] source... runs without any window
+    if (argc >= 2 && QString(argv[1]) == "--headless")
+    {
+        return HeadlessService::run(argc, argv);
+    }
+
     QApplication app(argc, argv);
     MainWindow window;
     window.setWindowTitle("MotionDetection");
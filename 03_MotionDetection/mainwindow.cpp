@@ -1,5 +1,6 @@
 #include <QApplication>
 #include <QFileDialog>
+#include <QFile>
 #include <QMessageBox>
 #include <QPixmap>
 #include <QKeyEvent>
@@ -7,18 +8,26 @@
 #include <QCameraInfo>
 #include <QGridLayout>
 #include <QIcon>
-#include <QStandardItem>
 #include <QSize>
+#include <QActionGroup>
+#include <QInputDialog>
+#include <QtMath>
 
 #include "opencv2/videoio.hpp"
 
 #include "mainwindow.h"
 #include "utilities.h"
+#include "clip_viewer.h"
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), fileMenu(nullptr), capturer(nullptr)
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), fileMenu(nullptr), analysisMenu(nullptr), recordingMenu(nullptr), capturer(nullptr)
 {
+    segment_seconds = 60;
+    storage_budget_gb = 0;
+    zones = MotionZones::load(MotionZones::zonesPath());
+    qRegisterMetaType<PipelineStats::Summary>("PipelineStats::Summary");
     initUI();
     data_lock = new QMutex();
+    analysis_pool = new QThreadPool(this);
 }
 
 void MainWindow::initUI()
@@ -26,6 +35,8 @@ void MainWindow::initUI()
     this->resize(1000, 800);
     // setup menubar
     fileMenu = menuBar()->addMenu("&File");
+    analysisMenu = menuBar()->addMenu("&Analysis");
+    recordingMenu = menuBar()->addMenu("&Recording");
 
     // main area
     QGridLayout *main_layout = new QGridLayout();
@@ -33,6 +44,17 @@ void MainWindow::initUI()
     imageView = new QGraphicsView(imageScene);
     main_layout->addWidget(imageView, 0, 0, 12, 1);
 
+    statsOverlay = new QLabel(imageView);
+    statsOverlay->setStyleSheet("background-color: rgba(0, 0, 0, 160); color: white; font-family: monospace; padding: 4px;");
+    statsOverlay->move(8, 8);
+    statsOverlay->hide();
+
+    gridWidget = new QWidget(this);
+    grid_layout = new QGridLayout(gridWidget);
+    grid_layout->setSpacing(2);
+    main_layout->addWidget(gridWidget, 0, 0, 12, 1);
+    gridWidget->hide();
+
     // tools
     QGridLayout *tools_layout = new QGridLayout();
     main_layout->addLayout(tools_layout, 12, 0, 1, 1);
@@ -54,8 +76,11 @@ void MainWindow::initUI()
     saved_list->setResizeMode(QListView::Adjust);
     saved_list->setSpacing(5);
     saved_list->setWrapping(false);
-    list_model = new QStandardItemModel(this);
+    saved_list->setUniformItemSizes(true); // don't ask every row for its size
+    saved_list->setLayoutMode(QListView::Batched);
+    list_model = new SavedVideoModel(this);
     saved_list->setModel(list_model);
+    connect(saved_list, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(openSavedVideo(QModelIndex)));
     main_layout->addWidget(saved_list, 13, 0, 4, 1);
 
     QWidget *widget = new QWidget();
@@ -67,6 +92,10 @@ void MainWindow::initUI()
     mainStatusLabel = new QLabel(mainStatusBar);
     mainStatusBar->addPermanentWidget(mainStatusLabel);
     mainStatusLabel->setText("Motion Detection is Ready");
+    writerStatusLabel = new QLabel(mainStatusBar);
+    mainStatusBar->addWidget(writerStatusLabel);
+    zoneStatusLabel = new QLabel(mainStatusBar);
+    mainStatusBar->addWidget(zoneStatusLabel);
 
     createActions();
     populateSavedList();
@@ -79,16 +108,85 @@ void MainWindow::createActions()
     fileMenu->addAction(cameraInfoAction);
     openCameraAction = new QAction("&Open Camera", this);
     fileMenu->addAction(openCameraAction);
-    calcFPSAction = new QAction("&Calculate FPS", this);
-    fileMenu->addAction(calcFPSAction);
+    openVideoAction = new QAction("Open &Video File...", this);
+    fileMenu->addAction(openVideoAction);
+    openStreamAction = new QAction("Open &Stream URL...", this);
+    fileMenu->addAction(openStreamAction);
+    openSourcesAction = new QAction("Open &Multiple Sources...", this);
+    fileMenu->addAction(openSourcesAction);
+    fastReplayAction = new QAction("Fast &Replay of Video Files", this);
+    fastReplayAction->setCheckable(true);
+    fileMenu->addAction(fastReplayAction);
+    statsAction = new QAction("Show S&tatistics", this);
+    statsAction->setCheckable(true);
+    fileMenu->addAction(statsAction);
     exitAction = new QAction("E&xit", this);
     fileMenu->addAction(exitAction);
 
+    // analysis resolution, motion detection runs on a downscaled copy of each frame
+    const char *scale_names[3] = {"&Full Resolution", "&1/2 Resolution", "1/&4 Resolution"};
+    QActionGroup *scale_group = new QActionGroup(this);
+    for (int i = 0; i < 3; i++)
+    {
+        scaleActions[i] = new QAction(scale_names[i], this);
+        scaleActions[i]->setCheckable(true);
+        scale_group->addAction(scaleActions[i]);
+        analysisMenu->addAction(scaleActions[i]);
+        connect(scaleActions[i], SIGNAL(triggered(bool)), this, SLOT(changeAnalysisScale()));
+    }
+    scaleActions[0]->setChecked(true);
+    analysisMenu->addSeparator();
+    grayscaleAction = new QAction("&Grayscale Analysis", this);
+    grayscaleAction->setCheckable(true);
+    analysisMenu->addAction(grayscaleAction);
+    adaptiveAction = new QAction("&Adaptive Frame Skipping", this);
+    adaptiveAction->setCheckable(true);
+    adaptiveAction->setChecked(true);
+    analysisMenu->addAction(adaptiveAction);
+    analysisMenu->addSeparator();
+    loadZonesAction = new QAction("Load &Zones...", this);
+    analysisMenu->addAction(loadZonesAction);
+    clearZonesAction = new QAction("&Clear Zones", this);
+    analysisMenu->addAction(clearZonesAction);
+
+    // continuous recording into segments with a storage budget
+    continuousAction = new QAction("&Continuous Recording", this);
+    continuousAction->setCheckable(true);
+    recordingMenu->addAction(continuousAction);
+    segmentLengthAction = new QAction("&Segment Length...", this);
+    recordingMenu->addAction(segmentLengthAction);
+    storageBudgetAction = new QAction("Storage &Budget...", this);
+    recordingMenu->addAction(storageBudgetAction);
+
+    // recording format, in the order of VideoWriterThread::Codec
+    recordingMenu->addSeparator();
+    const char *codec_names[4] = {"&MJPG (.avi)", "&H.264 (.mp4)", "MPEG-&4 (.mp4)", "Camera MJPEG &Passthrough (.mjpeg)"};
+    QActionGroup *codec_group = new QActionGroup(this);
+    for (int i = 0; i < 4; i++)
+    {
+        codecActions[i] = new QAction(codec_names[i], this);
+        codecActions[i]->setCheckable(true);
+        codec_group->addAction(codecActions[i]);
+        recordingMenu->addAction(codecActions[i]);
+        connect(codecActions[i], SIGNAL(triggered(bool)), this, SLOT(changeRecordingCodec()));
+    }
+    codecActions[0]->setChecked(true);
+
     // connect the signals and slots
     connect(exitAction, SIGNAL(triggered(bool)), QApplication::instance(), SLOT(quit()));
     connect(cameraInfoAction, SIGNAL(triggered(bool)), this, SLOT(showCameraInfo()));
     connect(openCameraAction, SIGNAL(triggered(bool)), this, SLOT(openCamera()));
-    connect(calcFPSAction, SIGNAL(triggered(bool)), this, SLOT(calculateFPS()));
+    connect(openSourcesAction, SIGNAL(triggered(bool)), this, SLOT(openSources()));
+    connect(openVideoAction, SIGNAL(triggered(bool)), this, SLOT(openVideo()));
+    connect(openStreamAction, SIGNAL(triggered(bool)), this, SLOT(openStream()));
+    connect(statsAction, SIGNAL(toggled(bool)), this, SLOT(showStatistics(bool)));
+    connect(grayscaleAction, SIGNAL(toggled(bool)), this, SLOT(changeAnalysisGrayscale(bool)));
+    connect(adaptiveAction, SIGNAL(toggled(bool)), this, SLOT(changeAdaptiveAnalysis(bool)));
+    connect(loadZonesAction, SIGNAL(triggered(bool)), this, SLOT(loadZones()));
+    connect(clearZonesAction, SIGNAL(triggered(bool)), this, SLOT(clearZones()));
+    connect(continuousAction, SIGNAL(toggled(bool)), this, SLOT(changeContinuousRecording(bool)));
+    connect(segmentLengthAction, SIGNAL(triggered(bool)), this, SLOT(changeSegmentLength()));
+    connect(storageBudgetAction, SIGNAL(triggered(bool)), this, SLOT(changeStorageBudget()));
 }
 
 void MainWindow::showCameraInfo()
@@ -104,42 +202,246 @@ void MainWindow::showCameraInfo()
     QMessageBox::information(this, "Cameras", info);
 }
 
-void MainWindow::openCamera()
+// Stop the single camera and all sources of the grid view
+void MainWindow::stopCapture()
 {
     if (capturer != nullptr)
     {
         // if a thread is already running, stop it
         capturer->setRunning(false);
         disconnect(capturer, &CaptureThread::frameCaptured, this, &MainWindow::updateFrame);
-        disconnect(capturer, &CaptureThread::fpsChanged, this, &MainWindow::updateFPS);
+        disconnect(capturer, &CaptureThread::statsChanged, this, &MainWindow::updateStats);
         disconnect(capturer, &CaptureThread::videoSaved, this, &MainWindow::appendSavedVideo);
-        connect(capturer, &CaptureThread::finished, capturer, &CaptureThread::deleteLater);
+        disconnect(capturer, &CaptureThread::writerStatsChanged, this, &MainWindow::updateWriterStats);
+        disconnect(capturer, &CaptureThread::zoneEnergyChanged, this, &MainWindow::updateZoneEnergy);
+        if (capturer->isFinished())
+        {
+            // e.g. a video file that has ended, finished() was emitted already
+            delete capturer;
+        }
+        else
+        {
+            connect(capturer, &CaptureThread::finished, capturer, &CaptureThread::deleteLater);
+        }
+        capturer = nullptr;
+    }
+
+    for (int i = 0; i < sources.size(); i++)
+    {
+        CaptureThread *source = sources[i];
+        QMutex *lock = source_locks[i];
+        disconnect(source, nullptr, this, nullptr);
+        if (source->isFinished())
+        {
+            // e.g. a video file that has ended or could not be opened
+            delete source;
+            delete lock;
+            continue;
+        }
+        source->setRunning(false);
+        connect(source, &CaptureThread::finished, source, &CaptureThread::deleteLater);
+        // the lock is used by the thread until it has finished
+        connect(source, &CaptureThread::finished, [lock]()
+                { delete lock; });
+    }
+    sources.clear();
+    source_locks.clear();
+
+    qDeleteAll(tiles);
+    tiles.clear();
+    gridWidget->hide();
+    imageView->show();
+}
+
+QList<CaptureThread *> MainWindow::capturers()
+{
+    if (capturer != nullptr)
+    {
+        return QList<CaptureThread *>() << capturer;
     }
-    
+    return sources;
+}
+
+void MainWindow::openCamera()
+{
     int camID = 0;
-    capturer = new CaptureThread(camID, data_lock);
+    startCapture(new CaptureThread(camID, data_lock), QString("Capturing Camera %1").arg(camID));
+}
+
+void MainWindow::openVideo()
+{
+    QString path = QFileDialog::getOpenFileName(
+        this, "Open Video File", QDir::homePath(), "Videos (*.mp4 *.avi *.mov *.mkv *.m4v);;All files (*)");
+    if (path.isEmpty())
+    {
+        return;
+    }
+    startCapture(new CaptureThread(path, data_lock), QString("Playing %1").arg(QFileInfo(path).fileName()));
+}
+
+void MainWindow::openStream()
+{
+    bool ok = false;
+    QString url = QInputDialog::getText(
+        this, "Open Stream URL", "Stream URL (e.g. rtsp://host:554/stream):", QLineEdit::Normal, "", &ok);
+    if (!ok || url.trimmed().isEmpty())
+    {
+        return;
+    }
+    startCapture(new CaptureThread(url.trimmed(), data_lock), QString("Streaming %1").arg(url.trimmed()));
+}
+
+void MainWindow::startCapture(CaptureThread *thread, QString status)
+{
+    stopCapture();
+
+    capturer = thread;
+    capturer->setReplayMode(fastReplayAction->isChecked() ? CaptureThread::FAST : CaptureThread::REALTIME);
     connect(capturer, &CaptureThread::frameCaptured, this, &MainWindow::updateFrame);
-    connect(capturer, &CaptureThread::fpsChanged, this, &MainWindow::updateFPS);
+    connect(capturer, &CaptureThread::statsChanged, this, &MainWindow::updateStats);
     connect(capturer, &CaptureThread::videoSaved, this, &MainWindow::appendSavedVideo);
+    connect(capturer, &CaptureThread::writerStatsChanged, this, &MainWindow::updateWriterStats);
+    connect(capturer, &CaptureThread::zoneEnergyChanged, this, &MainWindow::updateZoneEnergy);
+    changeAnalysisScale();
+    changeAnalysisGrayscale(grayscaleAction->isChecked());
+    changeAdaptiveAnalysis(adaptiveAction->isChecked());
+    applyZones();
+    changeContinuousRecording(continuousAction->isChecked());
+    changeRecordingCodec();
+    showStatistics(statsAction->isChecked());
     capturer->start();
-    mainStatusLabel->setText(QString("Capturing Camera %1").arg(camID));
+    mainStatusLabel->setText(status);
     monitorCheckBox->setCheckState(Qt::Unchecked);
     recordButton->setText("Record");
     recordButton->setEnabled(true);
 }
 
-void MainWindow::calculateFPS()
+/*
+ * Monitor several cameras or video files/URLs at once. Each source has its
+ * own capture thread, the motion analysis of all of them is scheduled on one
+ * shared thread pool. One source per line, optionally followed by "| priority".
+ */
+void MainWindow::openSources()
 {
-    if (capturer != nullptr)
+    bool ok = false;
+    QString text = QInputDialog::getMultiLineText(
+        this, "Open Multiple Sources",
+        "One camera index, video file or URL per line, optionally followed by \"| priority\":",
+        "0\n1", &ok);
+    if (!ok)
+    {
+        return;
+    }
+
+    QStringList lines;
+    foreach (QString line, text.split('\n'))
+    {
+        if (!line.trimmed().isEmpty())
+        {
+            lines << line.trimmed();
+        }
+    }
+    if (lines.isEmpty())
+    {
+        return;
+    }
+
+    stopCapture();
+    imageScene->clear();
+    imageView->hide();
+    gridWidget->show();
+
+    int columns = qCeil(qSqrt(lines.size()));
+    for (int i = 0; i < lines.size(); i++)
+    {
+        QString source = lines[i];
+        int priority = 0;
+        int bar = source.lastIndexOf('|');
+        if (bar >= 0)
+        {
+            priority = source.mid(bar + 1).trimmed().toInt();
+            source = source.left(bar).trimmed();
+        }
+
+        QMutex *lock = new QMutex();
+        bool is_camera = false;
+        int camID = source.toInt(&is_camera);
+        CaptureThread *thread = is_camera ? new CaptureThread(camID, lock) : new CaptureThread(source, lock);
+        thread->setAnalysisPool(analysis_pool, priority);
+        thread->setPreviewScale(1.0 / columns);
+        thread->setSourceName(QString("src%1").arg(i));
+        thread->setReplayMode(fastReplayAction->isChecked() ? CaptureThread::FAST : CaptureThread::REALTIME);
+        connect(thread, &CaptureThread::frameCaptured, this, &MainWindow::updateTile);
+        connect(thread, &CaptureThread::videoSaved, this, &MainWindow::appendSavedVideo);
+        connect(thread, &CaptureThread::statsChanged, this, &MainWindow::updateStats);
+        sources << thread;
+        source_locks << lock;
+
+        QLabel *tile = new QLabel(gridWidget);
+        tile->setMinimumSize(160, 120);
+        tile->setAlignment(Qt::AlignCenter);
+        tile->setToolTip(source);
+        tile->setStyleSheet("background-color: black;");
+        grid_layout->addWidget(tile, i / columns, i % columns);
+        tiles << tile;
+    }
+
+    changeAnalysisScale();
+    changeAnalysisGrayscale(grayscaleAction->isChecked());
+    changeAdaptiveAnalysis(adaptiveAction->isChecked());
+    applyZones();
+    changeContinuousRecording(continuousAction->isChecked());
+    changeRecordingCodec();
+    showStatistics(statsAction->isChecked());
+    foreach (CaptureThread *thread, sources)
+    {
+        thread->start();
+    }
+    mainStatusLabel->setText(QString("Monitoring %1 sources").arg(sources.size()));
+    monitorCheckBox->setCheckState(Qt::Unchecked);
+    recordButton->setText("Record");
+    recordButton->setEnabled(true);
+}
+
+/*
+ * Rolling frame rates and latency percentiles are measured continuously,
+ * this only controls whether latencies are recorded and shown.
+ */
+void MainWindow::showStatistics(bool show)
+{
+    foreach (CaptureThread *thread, capturers())
+    {
+        thread->setStatsEnabled(show);
+    }
+    statsOverlay->setVisible(show && capturer != nullptr);
+}
+
+void MainWindow::updateStats(PipelineStats::Summary summary)
+{
+    QString text = PipelineStats::format(summary);
+    int i = sources.indexOf(qobject_cast<CaptureThread *>(sender()));
+    if (i >= 0)
     {
-        capturer->startCalcFPS();
+        // too small for an overlay, the tile shows them on hover
+        tiles[i]->setToolTip(text);
+        return;
     }
+    statsOverlay->setText(text);
+    statsOverlay->adjustSize();
 }
 
 void MainWindow::updateFrame(cv::Mat *mat)
 {
+    qint64 paint_start = PipelineStats::now();
+    CaptureThread *thread = qobject_cast<CaptureThread *>(sender());
+    qint64 grabbed = 0;
+
     data_lock->lock();
     currentFrame = *mat;
+    if (thread != nullptr)
+    {
+        grabbed = thread->frameTimestamp();
+    }
     data_lock->unlock();
 
     QImage frame(
@@ -155,75 +457,278 @@ void MainWindow::updateFrame(cv::Mat *mat)
     imageScene->addPixmap(image);
     imageScene->update();
     imageView->setSceneRect(image.rect());
+
+    if (thread != nullptr)
+    {
+        qint64 painted = PipelineStats::now();
+        PipelineStats *stats = thread->pipelineStats();
+        stats->addLatency(PipelineStats::PAINT, painted - paint_start);
+        stats->addLatency(PipelineStats::GRAB_TO_PAINT, painted - grabbed);
+        stats->addEvent(PipelineStats::DISPLAYED, painted);
+    }
 }
 
-void MainWindow::updateFPS(float fps)
+void MainWindow::updateTile(cv::Mat *mat)
 {
-    mainStatusLabel->setText(QString("FPS of current camera is %1").arg(fps));
+    int i = sources.indexOf(qobject_cast<CaptureThread *>(sender()));
+    if (i < 0)
+    {
+        return;
+    }
+
+    // the frame is already downscaled by the capture thread, just copy and fit it
+    qint64 paint_start = PipelineStats::now();
+    source_locks[i]->lock();
+    QImage frame(mat->data, mat->cols, mat->rows, mat->step, QImage::Format_RGB888);
+    QPixmap image = QPixmap::fromImage(frame);
+    qint64 grabbed = sources[i]->frameTimestamp();
+    source_locks[i]->unlock();
+
+    tiles[i]->setPixmap(image.scaled(tiles[i]->size(), Qt::KeepAspectRatio, Qt::FastTransformation));
+
+    qint64 painted = PipelineStats::now();
+    PipelineStats *stats = sources[i]->pipelineStats();
+    stats->addLatency(PipelineStats::PAINT, painted - paint_start);
+    stats->addLatency(PipelineStats::GRAB_TO_PAINT, painted - grabbed);
+    stats->addEvent(PipelineStats::DISPLAYED, painted);
+}
+
+void MainWindow::updateWriterStats(int queue_depth, int dropped_frames, double avg_write_ms)
+{
+    writerStatusLabel->setText(
+        QString("Writer queue: %1, dropped: %2, write: %3 ms")
+            .arg(queue_depth)
+            .arg(dropped_frames)
+            .arg(avg_write_ms, 0, 'f', 1));
 }
 
 void MainWindow::recordingStartStop()
 {
     QString text = recordButton->text();
-    if (text == "Record" && capturer != nullptr)
+    QList<CaptureThread *> threads = capturers();
+    if (text == "Record" && !threads.isEmpty())
     {
-        capturer->setVideoSavingStatus(CaptureThread::STARTING);
+        foreach (CaptureThread *thread, threads)
+        {
+            thread->setVideoSavingStatus(CaptureThread::STARTING);
+        }
         recordButton->setText("Stop Recording");
         monitorCheckBox->setCheckState(Qt::Unchecked);
         monitorCheckBox->setEnabled(false);
     }
-    else if (text == "Stop Recording" && capturer != nullptr)
+    else if (text == "Stop Recording" && !threads.isEmpty())
     {
-        capturer->setVideoSavingStatus(CaptureThread::STOPPING);
+        foreach (CaptureThread *thread, threads)
+        {
+            thread->setVideoSavingStatus(CaptureThread::STOPPING);
+        }
         recordButton->setText("Record");
         monitorCheckBox->setEnabled(true);
     }
 }
 
+/*
+ * The saved list comes from the event index instead of a directory scan.
+ * Covers without an index entry are clips recorded by older versions.
+ * Thumbnails are loaded by the model once their rows become visible.
+ */
 void MainWindow::populateSavedList()
 {
+    QStringList names;
+    QHash<QString, QString> tooltips;
+    foreach (const MotionEvent &event, EventIndex::load())
+    {
+        saved_events.insert(event.name, event);
+        names << event.name;
+        tooltips.insert(event.name, QString("%1 s, peak motion at %2 s").arg(event.duration(), 0, 'f', 1).arg(event.peakSecond()));
+    }
+
     QDir dir(Utilities::getDataPath());
     QStringList nameFilters;
     nameFilters << "*.jpg";
-    QFileInfoList files = dir.entryInfoList(
-        nameFilters, QDir::NoDotAndDotDot | QDir::Files, QDir::Name);
-
-    foreach (QFileInfo cover, files)
+    foreach (QFileInfo cover, dir.entryInfoList(nameFilters, QDir::NoDotAndDotDot | QDir::Files))
     {
-        QString name = cover.baseName();
-        QStandardItem *item = new QStandardItem();
-        list_model->appendRow(item);
-        QModelIndex index = list_model->indexFromItem(item);
-        list_model->setData(index, QPixmap(cover.absoluteFilePath()).scaledToHeight(145), Qt::DecorationRole);
-        list_model->setData(index, name, Qt::DisplayRole);
+        if (!saved_events.contains(cover.completeBaseName()))
+        {
+            names << cover.completeBaseName();
+        }
     }
+    names.sort();
+    list_model->setVideos(names, tooltips);
 }
 
 void MainWindow::appendSavedVideo(QString name)
 {
-    QString cover = Utilities::getSavedVideoPath(name, "jpg");
-    QStandardItem *item = new QStandardItem();
-    list_model->appendRow(item);
-    QModelIndex index = list_model->indexFromItem(item);
-    list_model->setData(index, QPixmap(cover).scaledToHeight(145), Qt::DecorationRole);
-    list_model->setData(index, name, Qt::DisplayRole);
-    saved_list->scrollTo(index);
+    list_model->addVideo(name);
+    saved_list->scrollTo(list_model->index(list_model->rowCount() - 1));
+}
+
+void MainWindow::openSavedVideo(const QModelIndex &index)
+{
+    QString name = index.data(Qt::DisplayRole).toString();
+    if (!saved_events.contains(name))
+    {
+        // recorded during this session, the writer has appended it to the index by now
+        foreach (const MotionEvent &event, EventIndex::load())
+        {
+            saved_events.insert(event.name, event);
+        }
+    }
+    MotionEvent event = saved_events.value(name);
+    event.name = name;
+
+    ClipViewer viewer(event, this);
+    viewer.exec();
 }
 
 void MainWindow::updateMonitorStatus(int status)
 {
-    if (capturer == nullptr)
+    QList<CaptureThread *> threads = capturers();
+    if (threads.isEmpty())
     {
         return;
     }
-    if (status)
+    foreach (CaptureThread *thread, threads)
+    {
+        thread->setMotionDetectingStatus(status != 0);
+    }
+    recordButton->setEnabled(status == 0);
+}
+
+void MainWindow::changeAnalysisScale()
+{
+    const double scales[3] = {1.0, 0.5, 0.25};
+    double scale = 1.0;
+    for (int i = 0; i < 3; i++)
+    {
+        if (scaleActions[i]->isChecked())
+        {
+            scale = scales[i];
+        }
+    }
+    foreach (CaptureThread *thread, capturers())
+    {
+        thread->setAnalysisScale(scale);
+    }
+}
+
+void MainWindow::changeAnalysisGrayscale(bool gray)
+{
+    foreach (CaptureThread *thread, capturers())
+    {
+        thread->setAnalysisGrayscale(gray);
+    }
+}
+
+void MainWindow::changeAdaptiveAnalysis(bool adaptive)
+{
+    foreach (CaptureThread *thread, capturers())
+    {
+        thread->setAdaptiveAnalysis(adaptive);
+    }
+}
+
+// Every capture thread gets the zones, the live per-zone energy is shown again once it reports
+void MainWindow::applyZones()
+{
+    foreach (CaptureThread *thread, capturers())
+    {
+        thread->setZones(zones);
+    }
+    zoneStatusLabel->clear();
+}
+
+// The zones file is copied to the data directory and loaded again on the next start
+void MainWindow::loadZones()
+{
+    QString path = QFileDialog::getOpenFileName(this, "Load Zones", QDir::homePath(), "Zones (*.json)");
+    if (path.isEmpty())
+    {
+        return;
+    }
+    zones = MotionZones::load(path);
+    if (zones.empty())
+    {
+        QMessageBox::warning(this, "Zones", "No valid zones found in " + path);
+        return;
+    }
+    if (QFileInfo(path) != QFileInfo(MotionZones::zonesPath()))
+    {
+        QFile::remove(MotionZones::zonesPath());
+        QFile::copy(path, MotionZones::zonesPath());
+    }
+    applyZones();
+}
+
+void MainWindow::clearZones()
+{
+    zones.clear();
+    QFile::remove(MotionZones::zonesPath());
+    applyZones();
+}
+
+void MainWindow::updateZoneEnergy(QVector<double> energy)
+{
+    QStringList parts;
+    for (int i = 0; i < energy.size() && i < (int)zones.size(); i++)
+    {
+        if (zones[i].include)
+        {
+            parts << QString("%1 %2%").arg(QString::fromStdString(zones[i].name)).arg(energy[i] * 100, 0, 'f', 1);
+        }
+    }
+    zoneStatusLabel->setText("Zones: " + parts.join(", "));
+}
+
+/*
+ * Segment length and budget are passed on together with the on/off switch,
+ * a running capture picks them up the next time continuous recording starts.
+ */
+void MainWindow::changeContinuousRecording(bool continuous)
+{
+    foreach (CaptureThread *thread, capturers())
+    {
+        thread->setSegmentLength(segment_seconds);
+        thread->setStorageBudget((qint64)storage_budget_gb << 30);
+        thread->setContinuousRecording(continuous);
+    }
+}
+
+void MainWindow::changeSegmentLength()
+{
+    bool ok = false;
+    int seconds = QInputDialog::getInt(this, "Segment Length", "Seconds per segment:", segment_seconds, 10, 3600, 10, &ok);
+    if (ok)
+    {
+        segment_seconds = seconds;
+        changeContinuousRecording(continuousAction->isChecked());
+    }
+}
+
+void MainWindow::changeStorageBudget()
+{
+    bool ok = false;
+    int gb = QInputDialog::getInt(this, "Storage Budget", "GB for all segments (0 keeps everything):", storage_budget_gb, 0, 100000, 1, &ok);
+    if (ok)
+    {
+        storage_budget_gb = gb;
+        changeContinuousRecording(continuousAction->isChecked());
+    }
+}
+
+// Passthrough needs the camera to be reopened, the other formats apply to the next recording
+void MainWindow::changeRecordingCodec()
+{
+    VideoWriterThread::Codec codec = VideoWriterThread::MJPG_AVI;
+    for (int i = 0; i < 4; i++)
     {
-        capturer->setMotionDetectingStatus(true);
-        recordButton->setEnabled(false);
+        if (codecActions[i]->isChecked())
+        {
+            codec = (VideoWriterThread::Codec)i;
+        }
     }
-    else
+    foreach (CaptureThread *thread, capturers())
     {
-        capturer->setMotionDetectingStatus(false);
-        recordButton->setEnabled(true);
+        thread->setRecordingCodec(codec);
     }
 }
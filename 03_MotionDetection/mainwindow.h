@@ -12,10 +12,15 @@
 #include <QPushButton>
 #include <QGraphicsPixmapItem>
 #include <QMutex>
-#include <QStandardItemModel>
+#include <QThreadPool>
+#include <QList>
+#include <QHash>
 
 #include "opencv2/opencv.hpp"
 #include "capture_thread.h"
+#include "event_index.h"
+#include "saved_video_model.h"
+#include "motion_zones.h"
 
 class MainWindow : public QMainWindow
 {
@@ -29,40 +34,96 @@ private:
     void initUI();
     void createActions();
     void populateSavedList();
+    void stopCapture();
+    void startCapture(CaptureThread *thread, QString status);
+    QList<CaptureThread *> capturers();
+    void applyZones();
 
 private slots:
     void showCameraInfo();
     void openCamera();
+    void openSources();
+    void openVideo();
+    void openStream();
     void updateFrame(cv::Mat *);
-    void calculateFPS();
-    void updateFPS(float);
+    void updateTile(cv::Mat *);
+    void showStatistics(bool show);
+    void updateStats(PipelineStats::Summary summary);
     void recordingStartStop();
     void appendSavedVideo(QString name);
+    void openSavedVideo(const QModelIndex &index);
     void updateMonitorStatus(int status);
+    void updateWriterStats(int queue_depth, int dropped_frames, double avg_write_ms);
+    void changeAnalysisScale();
+    void changeAnalysisGrayscale(bool gray);
+    void changeAdaptiveAnalysis(bool adaptive);
+    void loadZones();
+    void clearZones();
+    void updateZoneEnergy(QVector<double> energy);
+    void changeContinuousRecording(bool continuous);
+    void changeSegmentLength();
+    void changeStorageBudget();
+    void changeRecordingCodec();
 
 private:
     QMenu *fileMenu;
+    QMenu *analysisMenu;
+    QMenu *recordingMenu;
 
     QAction *cameraInfoAction;
     QAction *openCameraAction;
-    QAction *calcFPSAction;
+    QAction *openSourcesAction;
+    QAction *openVideoAction;
+    QAction *openStreamAction;
+    QAction *fastReplayAction;
+    QAction *statsAction;
     QAction *exitAction;
+    QAction *scaleActions[3];
+    QAction *grayscaleAction;
+    QAction *adaptiveAction;
+    QAction *loadZonesAction;
+    QAction *clearZonesAction;
+    QAction *continuousAction;
+    QAction *segmentLengthAction;
+    QAction *storageBudgetAction;
+    QAction *codecActions[4];
 
     QGraphicsScene *imageScene;
     QGraphicsView *imageView;
+    QLabel *statsOverlay; // pipeline statistics drawn over the image view
+
+    // grid of reduced-resolution tiles when monitoring several sources
+    QWidget *gridWidget;
+    QGridLayout *grid_layout;
+    QList<QLabel *> tiles;
 
     QCheckBox *monitorCheckBox;
     QPushButton *recordButton;
 
     QListView *saved_list;
-    QStandardItemModel *list_model;
+    SavedVideoModel *list_model;
+    QHash<QString, MotionEvent> saved_events; // loaded from the event index
+
+    // motion zones of all sources
+    vector<MotionZone> zones;
+
+    // continuous recording settings
+    int segment_seconds;
+    int storage_budget_gb; // 0 keeps all segments
 
     QStatusBar *mainStatusBar;
     QLabel *mainStatusLabel;
+    QLabel *writerStatusLabel;
+    QLabel *zoneStatusLabel;
 
     cv::Mat currentFrame;
 
     // for capture thread
     QMutex *data_lock;
     CaptureThread *capturer;
+
+    // for monitoring several sources, motion analysis runs on a shared pool
+    QList<CaptureThread *> sources;
+    QList<QMutex *> source_locks;
+    QThreadPool *analysis_pool;
 };
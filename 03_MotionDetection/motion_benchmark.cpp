@@ -0,0 +1,109 @@
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+#include "opencv2/videoio.hpp"
+
+#include "motion_detector.h"
+#include "motion_benchmark.h"
+
+using namespace std;
+
+struct BenchmarkConfig
+{
+    double scale;
+    bool gray;
+};
+
+// Rasterize the boxes of one frame into a coarse mask so that configurations can be compared
+static cv::Mat boxesMask(const vector<cv::Rect> &boxes, cv::Size frame_size)
+{
+    const int cell = 8;
+    cv::Mat mask = cv::Mat::zeros((frame_size.height + cell - 1) / cell, (frame_size.width + cell - 1) / cell, CV_8UC1);
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        cv::Rect r(boxes[i].x / cell, boxes[i].y / cell, (boxes[i].width + cell - 1) / cell, (boxes[i].height + cell - 1) / cell);
+        mask(r & cv::Rect(0, 0, mask.cols, mask.rows)) = 255;
+    }
+    return mask;
+}
+
+static double boxesIoU(const vector<cv::Rect> &a, const vector<cv::Rect> &b, cv::Size frame_size)
+{
+    cv::Mat ma = boxesMask(a, frame_size);
+    cv::Mat mb = boxesMask(b, frame_size);
+    int inter = cv::countNonZero(ma & mb);
+    int uni = cv::countNonZero(ma | mb);
+    return uni > 0 ? (double)inter / uni : 1.0;
+}
+
+int MotionBenchmark::run(QString videoPath, int max_frames)
+{
+    vector<BenchmarkConfig> configs = {
+        {1.0, false}, {1.0, true}, {0.5, false}, {0.5, true}, {0.25, false}, {0.25, true}};
+
+    // Per-frame boxes of the reference configuration (full resolution, color)
+    vector<vector<cv::Rect>> reference;
+
+    cout << "scale  gray  frames  wall ms/frame  cpu ms/frame  motion agreement  mean IoU" << endl;
+    for (size_t c = 0; c < configs.size(); c++)
+    {
+        cv::VideoCapture cap(videoPath.toStdString());
+        if (!cap.isOpened())
+        {
+            cerr << "Error opening video file " << videoPath.toStdString() << endl;
+            return 1;
+        }
+
+        MotionDetector detector(configs[c].scale, configs[c].gray);
+        cv::Mat frame;
+        vector<cv::Rect> boxes;
+        int64 ticks = 0;
+        clock_t cpu = 0;
+        int frames = 0, agreed = 0, compared = 0;
+        double iou_sum = 0.0;
+
+        while (frames < max_frames && cap.read(frame))
+        {
+            // Only the analysis itself is measured, decoding is excluded
+            int64 t0 = cv::getTickCount();
+            clock_t c0 = clock();
+            bool has_motion = detector.detect(frame, boxes);
+            cpu += clock() - c0;
+            ticks += cv::getTickCount() - t0;
+
+            if (c == 0)
+            {
+                reference.push_back(boxes);
+            }
+            else if ((size_t)frames < reference.size())
+            {
+                bool ref_motion = !reference[frames].empty();
+                agreed += (ref_motion == has_motion);
+                if (ref_motion || has_motion)
+                {
+                    iou_sum += boxesIoU(reference[frames], boxes, frame.size());
+                    compared++;
+                }
+            }
+            frames++;
+        }
+
+        if (frames == 0)
+        {
+            cerr << "No frames could be read from " << videoPath.toStdString() << endl;
+            return 1;
+        }
+
+        double wall_ms = ticks * 1000.0 / cv::getTickFrequency() / frames;
+        double cpu_ms = cpu * 1000.0 / CLOCKS_PER_SEC / frames;
+        double agreement = c == 0 ? 1.0 : (double)agreed / frames;
+        double mean_iou = c == 0 || compared == 0 ? 1.0 : iou_sum / compared;
+        cout << cv::format("%5.2f  %4s  %6d  %13.2f  %12.2f  %15.1f%%  %8.3f",
+                           configs[c].scale, configs[c].gray ? "yes" : "no", frames,
+                           wall_ms, cpu_ms, agreement * 100, mean_iou)
+             << endl;
+    }
+    return 0;
+}
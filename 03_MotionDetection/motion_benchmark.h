@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QString>
+
+/*
+ * Offline comparison of MotionDetector analysis settings on a recorded video.
+ * Full-resolution color analysis is the reference; every other setting is
+ * scored by how well its motion boxes agree with it and by how much time it
+ * spends per frame.
+ */
+class MotionBenchmark
+{
+public:
+    static int run(QString videoPath, int max_frames = 1000);
+};
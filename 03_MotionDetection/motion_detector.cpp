@@ -0,0 +1,233 @@
+#include <cmath>
+
+#include "motion_detector.h"
+
+MotionDetector::MotionDetector(double scale, bool gray) : analysis_scale(scale), analysis_gray(gray), energy(0.0), min_area(100.0)
+{
+    zones_dirty = true;
+    included_pixels = 0;
+    reset();
+}
+
+void MotionDetector::setAnalysisScale(double scale)
+{
+    if (scale <= 0.0 || scale > 1.0 || scale == analysis_scale)
+    {
+        return;
+    }
+    analysis_scale = scale;
+    reset();
+}
+
+void MotionDetector::setGrayscale(bool gray)
+{
+    if (gray == analysis_gray)
+    {
+        return;
+    }
+    analysis_gray = gray;
+    reset();
+}
+
+void MotionDetector::setZones(const vector<MotionZone> &zones)
+{
+    this->zones = zones;
+    zones_dirty = true;
+}
+
+void MotionDetector::reset()
+{
+    // The background model is tied to the frame size and channel count
+    segmentor = cv::createBackgroundSubtractorMOG2(500, 16, true);
+
+    // Scale the 9x9 structuring element with the analysis resolution, keeping it odd and at least 3x3
+    int noise_size = max(3, (int)std::lround(9 * analysis_scale) | 1);
+    kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(noise_size, noise_size));
+    zones_dirty = true;
+}
+
+/*
+ * Rasterize the zones at analysis resolution. Axis-aligned rectangles are
+ * kept as rectangles so that their energy is four lookups in an integral
+ * image, other polygons get a mask of their own.
+ */
+void MotionDetector::compileZones(cv::Size size)
+{
+    zones_dirty = false;
+    mask_size = size;
+    cv::Rect frame_rect(cv::Point(0, 0), size);
+
+    vector<vector<cv::Point>> polygons(zones.size());
+    bool has_include = false;
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        for (size_t j = 0; j < zones[i].polygon.size(); j++)
+        {
+            polygons[i].push_back(cv::Point(cvRound(zones[i].polygon[j].x * size.width), cvRound(zones[i].polygon[j].y * size.height)));
+        }
+        has_include = has_include || (zones[i].include && polygons[i].size() >= 3);
+    }
+
+    cv::Mat mask(size, CV_8U, cv::Scalar(has_include ? 0 : 255));
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        if (zones[i].include && polygons[i].size() >= 3)
+        {
+            cv::fillPoly(mask, vector<vector<cv::Point>>{polygons[i]}, cv::Scalar(255));
+        }
+    }
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        if (!zones[i].include && polygons[i].size() >= 3)
+        {
+            cv::fillPoly(mask, vector<vector<cv::Point>>{polygons[i]}, cv::Scalar(0));
+        }
+    }
+
+    included_pixels = cv::countNonZero(mask);
+    zone_roi = included_pixels > 0 ? cv::boundingRect(mask) : cv::Rect();
+    zone_mask = cv::Mat();
+    if (included_pixels > 0 && included_pixels < zone_roi.area())
+    {
+        zone_mask = mask(zone_roi).clone();
+    }
+
+    zone_rects.assign(zones.size(), cv::Rect());
+    zone_masks.assign(zones.size(), cv::Mat());
+    zone_energy.assign(zones.size(), 0.0);
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        if (!zones[i].include || polygons[i].size() < 3)
+        {
+            continue;
+        }
+        cv::Rect rect = cv::boundingRect(polygons[i]) & frame_rect & zone_roi;
+        zone_rects[i] = rect - zone_roi.tl();
+        bool is_rect = polygons[i].size() == 4 && cv::contourArea(polygons[i]) >= 0.99 * cv::boundingRect(polygons[i]).area();
+        if (!is_rect || cv::countNonZero(mask(rect)) < rect.area())
+        {
+            // the zone's own pixels, minus anything excluded
+            cv::Mat own(size, CV_8U, cv::Scalar(0));
+            cv::fillPoly(own, vector<vector<cv::Point>>{polygons[i]}, cv::Scalar(255));
+            zone_masks[i] = own(rect) & mask(rect);
+        }
+    }
+
+    // The background model covers the roi only
+    segmentor = cv::createBackgroundSubtractorMOG2(500, 16, true);
+}
+
+bool MotionDetector::detect(const cv::Mat &frame, vector<cv::Rect> &boxes)
+{
+    boxes.clear();
+    energy = 0.0;
+
+    // Downscale first so that MOG2 and the morphology only touch the reduced image
+    if (analysis_scale < 1.0)
+    {
+        cv::resize(frame, analysis_frame, cv::Size(), analysis_scale, analysis_scale, cv::INTER_AREA);
+    }
+    else
+    {
+        analysis_frame = frame;
+    }
+    if (analysis_gray)
+    {
+        cv::cvtColor(analysis_frame, analysis_frame, cv::COLOR_BGR2GRAY);
+    }
+
+    if (zones_dirty || mask_size != analysis_frame.size())
+    {
+        compileZones(analysis_frame.size());
+    }
+    if (zone_roi.empty())
+    {
+        // everything is excluded
+        fgmask = cv::Mat();
+        return false;
+    }
+
+    segmentor->apply(analysis_frame(zone_roi), fgmask);
+    if (fgmask.empty())
+    {
+        return false;
+    }
+
+    // Shadows are marked as 127 by MOG2, keep only real foreground
+    cv::threshold(fgmask, fgmask, 25, 255, cv::THRESH_BINARY);
+    if (!zone_mask.empty())
+    {
+        fgmask &= zone_mask;
+    }
+    cv::erode(fgmask, fgmask, kernel);
+    cv::dilate(fgmask, fgmask, kernel, cv::Point(-1, -1), 3);
+    if (!zone_mask.empty())
+    {
+        // the dilation grows blobs back into excluded pixels
+        fgmask &= zone_mask;
+    }
+    energy = cv::countNonZero(fgmask) / (double)included_pixels;
+    zoneStatistics();
+
+    // Only outer contours matter for bounding boxes, holes and nested blobs are skipped
+    vector<vector<cv::Point>> contours;
+    cv::findContours(fgmask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+    // Map the boxes back to full resolution
+    double inv_scale = 1.0 / analysis_scale;
+    double scaled_min_area = min_area * analysis_scale * analysis_scale;
+    cv::Rect frame_rect(0, 0, frame.cols, frame.rows);
+    for (size_t i = 0; i < contours.size(); i++)
+    {
+        if (cv::contourArea(contours[i]) < scaled_min_area)
+        {
+            continue;
+        }
+        cv::Rect rect = cv::boundingRect(contours[i]) + zone_roi.tl();
+        if (analysis_scale < 1.0)
+        {
+            rect = cv::Rect(
+                cv::Point((int)std::floor(rect.x * inv_scale), (int)std::floor(rect.y * inv_scale)),
+                cv::Point((int)std::ceil(rect.br().x * inv_scale), (int)std::ceil(rect.br().y * inv_scale)));
+            rect &= frame_rect;
+        }
+        boxes.push_back(rect);
+    }
+
+    return !boxes.empty();
+}
+
+// Energy of every include zone, rectangles via the integral image and other shapes by counting
+void MotionDetector::zoneStatistics()
+{
+    bool use_integral = false;
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        use_integral = use_integral || (!zone_rects[i].empty() && zone_masks[i].empty());
+    }
+    if (use_integral)
+    {
+        cv::integral(fgmask, integral_sum, CV_64F); // 32-bit sums of 255s overflow at 4K
+    }
+
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        cv::Rect rect = zone_rects[i];
+        if (rect.empty())
+        {
+            zone_energy[i] = 0.0;
+            continue;
+        }
+        if (zone_masks[i].empty())
+        {
+            double sum = integral_sum.at<double>(rect.br()) - integral_sum.at<double>(rect.y, rect.br().x) -
+                         integral_sum.at<double>(rect.br().y, rect.x) + integral_sum.at<double>(rect.tl());
+            zone_energy[i] = sum / 255.0 / rect.area();
+        }
+        else
+        {
+            int area = cv::countNonZero(zone_masks[i]);
+            zone_energy[i] = area > 0 ? cv::countNonZero(fgmask(rect) & zone_masks[i]) / (double)area : 0.0;
+        }
+    }
+}
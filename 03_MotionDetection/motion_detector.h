@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "opencv2/video/background_segm.hpp"
+
+using namespace std;
+
+// A polygon in normalized frame coordinates (0..1). Motion outside all include
+// zones (if there are any) and inside exclude zones is ignored.
+struct MotionZone
+{
+    string name;
+    bool include;
+    vector<cv::Point2f> polygon;
+};
+
+/*
+ * MOG2 background subtraction plus morphology. The analysis can run on a
+ * downscaled (and optionally grayscale) copy of the frame, the resulting
+ * bounding boxes are always reported in full-resolution coordinates.
+ *
+ * Zones are compiled into a mask at analysis resolution. Only the bounding
+ * box of the included area goes through MOG2, and excluded pixels are cleared
+ * before the morphology, so they never grow into motion.
+ */
+class MotionDetector
+{
+public:
+    MotionDetector(double scale = 1.0, bool gray = false);
+
+    // Changing the analysis settings restarts the background model
+    void setAnalysisScale(double scale);
+    void setGrayscale(bool gray);
+    void setZones(const vector<MotionZone> &zones);
+    void setMinArea(double pixels) { min_area = pixels; }; // in full-resolution pixels
+    double analysisScale() const { return analysis_scale; };
+    bool grayscale() const { return analysis_gray; };
+    void reset();
+
+    // Returns true if there is motion in the frame, boxes are in frame coordinates
+    bool detect(const cv::Mat &frame, vector<cv::Rect> &boxes);
+
+    // Foreground mask of the last detect() call, at analysis resolution and
+    // cropped to the bounding box of the included area
+    const cv::Mat &foregroundMask() const { return fgmask; };
+
+    // Fraction of foreground pixels of the included area in the last detect() call, 0..1
+    double motionEnergy() const { return energy; };
+    // The same per zone, in the order of setZones(), exclude zones are always 0
+    const vector<double> &zoneEnergy() const { return zone_energy; };
+
+private:
+    double analysis_scale;
+    bool analysis_gray;
+
+    cv::Ptr<cv::BackgroundSubtractorMOG2> segmentor; // OpenCV's MOG2 background subtractor
+    cv::Mat kernel;
+    cv::Mat analysis_frame;
+    cv::Mat fgmask;
+    double energy;
+    double min_area;
+
+    void compileZones(cv::Size size);
+    void zoneStatistics();
+    vector<MotionZone> zones;
+    bool zones_dirty;
+    cv::Size mask_size;
+    cv::Rect zone_roi;      // bounding box of the included area
+    cv::Mat zone_mask;      // included pixels inside zone_roi, empty if all of them are
+    int included_pixels;
+    vector<cv::Rect> zone_rects;  // per zone, in zone_roi coordinates
+    vector<cv::Mat> zone_masks;   // per zone, empty for axis-aligned rectangles
+    vector<double> zone_energy;
+    cv::Mat integral_sum;
+};
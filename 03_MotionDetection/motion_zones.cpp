@@ -0,0 +1,50 @@
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+
+#include "utilities.h"
+#include "motion_zones.h"
+
+QString MotionZones::zonesPath()
+{
+    return Utilities::getDataPath() + "/zones.json";
+}
+
+vector<MotionZone> MotionZones::load(QString path)
+{
+    vector<MotionZone> zones;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return zones;
+    }
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (doc.isNull())
+    {
+        qWarning() << "Can't parse zones" << path << error.errorString();
+        return zones;
+    }
+
+    foreach (const QJsonValue &value, doc.object()["zones"].toArray())
+    {
+        QJsonObject json = value.toObject();
+        MotionZone zone;
+        zone.name = json["name"].toString().toStdString();
+        zone.include = json["type"].toString("include") != "exclude";
+        foreach (const QJsonValue &point, json["points"].toArray())
+        {
+            QJsonArray xy = point.toArray();
+            zone.polygon.push_back(cv::Point2f(xy[0].toDouble(), xy[1].toDouble()));
+        }
+        if (zone.polygon.size() < 3)
+        {
+            qWarning() << "Skipping zone" << json["name"].toString() << "with less than 3 points";
+            continue;
+        }
+        zones.push_back(zone);
+    }
+    return zones;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QString>
+#include "motion_detector.h"
+
+/*
+ * Zones are defined in a JSON file, by default zones.json in the data
+ * directory. Points are normalized to the frame size so that the same file
+ * works at every capture and analysis resolution:
+ *
+ *   {"zones": [
+ *       {"name": "driveway", "type": "include", "points": [[0.1, 0.5], [0.6, 0.5], [0.6, 1.0], [0.1, 1.0]]},
+ *       {"name": "tree", "type": "exclude", "points": [[0.7, 0.0], [1.0, 0.0], [1.0, 0.4]]}
+ *   ]}
+ */
+class MotionZones
+{
+public:
+    static QString zonesPath();
+    static vector<MotionZone> load(QString path);
+};
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <chrono>
+
+#include "pipeline_stats.h"
+
+RollingWindow::RollingWindow()
+{
+    for (int i = 0; i < SIZE; i++)
+    {
+        samples[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+}
+
+void RollingWindow::add(qint64 value)
+{
+    unsigned n = count.load(std::memory_order_relaxed);
+    samples[n % SIZE].store(value, std::memory_order_relaxed);
+    count.store(n + 1, std::memory_order_release);
+}
+
+int RollingWindow::snapshot(qint64 *out) const
+{
+    unsigned n = count.load(std::memory_order_acquire);
+    int size = (int)std::min<unsigned>(n, SIZE);
+    for (int i = 0; i < size; i++)
+    {
+        out[i] = samples[(n - size + i) % SIZE].load(std::memory_order_relaxed);
+    }
+    return size;
+}
+
+PipelineStats::PipelineStats()
+{
+    enabled_flag.store(false, std::memory_order_relaxed);
+}
+
+qint64 PipelineStats::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void PipelineStats::addLatency(Stage stage, qint64 us)
+{
+    if (enabled())
+    {
+        latencies[stage].add(us);
+    }
+}
+
+void PipelineStats::addEvent(Rate rate, qint64 timestamp_us)
+{
+    events[rate].add(timestamp_us);
+}
+
+// Frames per second over the events in the window
+double PipelineStats::rate(Rate rate) const
+{
+    qint64 t[RollingWindow::SIZE];
+    int n = events[rate].snapshot(t);
+    if (n < 2 || t[n - 1] <= t[0])
+    {
+        return 0.0;
+    }
+    return (n - 1) * 1e6 / (t[n - 1] - t[0]);
+}
+
+PipelineStats::Summary PipelineStats::summary() const
+{
+    Summary s;
+    for (int r = 0; r < RATE_COUNT; r++)
+    {
+        s.fps[r] = rate((Rate)r);
+    }
+
+    qint64 v[RollingWindow::SIZE];
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        int n = latencies[i].snapshot(v);
+        if (n == 0)
+        {
+            s.p50_ms[i] = s.p95_ms[i] = s.p99_ms[i] = 0.0;
+            continue;
+        }
+        std::sort(v, v + n);
+        s.p50_ms[i] = v[(n - 1) * 50 / 100] / 1000.0;
+        s.p95_ms[i] = v[(n - 1) * 95 / 100] / 1000.0;
+        s.p99_ms[i] = v[(n - 1) * 99 / 100] / 1000.0;
+    }
+    return s;
+}
+
+QString PipelineStats::format(const Summary &s)
+{
+    const char *names[STAGE_COUNT] = {"grab", "analysis", "display prep", "paint", "grab to paint"};
+    QString text = QString("capture %1 fps, processed %2 fps, display %3 fps\n")
+                       .arg(s.fps[CAPTURED], 0, 'f', 1)
+                       .arg(s.fps[PROCESSED], 0, 'f', 1)
+                       .arg(s.fps[DISPLAYED], 0, 'f', 1);
+    text += "stage          p50 / p95 / p99 ms";
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        text += QString("\n%1 %2 / %3 / %4")
+                    .arg(QString(names[i]), -14)
+                    .arg(s.p50_ms[i], 0, 'f', 1)
+                    .arg(s.p95_ms[i], 0, 'f', 1)
+                    .arg(s.p99_ms[i], 0, 'f', 1);
+    }
+    return text;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <QString>
+#include <QMetaType>
+
+/*
+ * Fixed-size ring of the most recent samples. Writing is lock-free and
+ * meant for one producer at a time, readers take a snapshot whenever they
+ * like and may miss a sample that is being written concurrently.
+ */
+class RollingWindow
+{
+public:
+    static const int SIZE = 256;
+
+    RollingWindow();
+    void add(qint64 value);
+    int snapshot(qint64 *out) const; // returns the number of samples copied, oldest first
+
+private:
+    std::atomic<qint64> samples[SIZE];
+    std::atomic<unsigned> count;
+};
+
+/*
+ * Rolling frame rates and per-stage latency percentiles of the capture
+ * pipeline, from grabbing a frame to painting it in the GUI. Stages are
+ * recorded by whichever thread runs them, summaries can be taken from any
+ * thread.
+ */
+class PipelineStats
+{
+public:
+    enum Stage
+    {
+        GRAB,          // cap >> frame
+        ANALYSIS,      // motion detection
+        DISPLAY_PREP,  // resize, color conversion and hand-over to the GUI
+        PAINT,         // QImage/QPixmap conversion and scene update
+        GRAB_TO_PAINT, // end-to-end
+        STAGE_COUNT
+    };
+
+    enum Rate
+    {
+        CAPTURED,
+        PROCESSED,
+        DISPLAYED,
+        RATE_COUNT
+    };
+
+    struct Summary
+    {
+        double fps[RATE_COUNT];
+        double p50_ms[STAGE_COUNT];
+        double p95_ms[STAGE_COUNT];
+        double p99_ms[STAGE_COUNT];
+    };
+
+    PipelineStats();
+
+    // Monotonic timestamp in microseconds
+    static qint64 now();
+
+    // Latencies are only recorded while enabled, frame rates always are
+    void setEnabled(bool on) { enabled_flag.store(on, std::memory_order_relaxed); };
+    bool enabled() const { return enabled_flag.load(std::memory_order_relaxed); };
+
+    void addLatency(Stage stage, qint64 us);
+    void addEvent(Rate rate, qint64 timestamp_us);
+
+    double rate(Rate rate) const;
+    Summary summary() const;
+    static QString format(const Summary &s);
+
+private:
+    std::atomic<bool> enabled_flag;
+    RollingWindow latencies[STAGE_COUNT];
+    RollingWindow events[RATE_COUNT];
+};
+
+Q_DECLARE_METATYPE(PipelineStats::Summary)
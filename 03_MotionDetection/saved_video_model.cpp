@@ -0,0 +1,156 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QDebug>
+
+#include "utilities.h"
+#include "saved_video_model.h"
+
+SavedVideoModel::SavedVideoModel(QObject *parent) : QAbstractListModel(parent), thumbnails(256)
+{
+    // decoding is I/O bound on large collections, two threads keep the disk busy
+    loader = new QThreadPool(this);
+    loader->setMaxThreadCount(2);
+
+    placeholder = QPixmap(THUMBNAIL_HEIGHT * 4 / 3, THUMBNAIL_HEIGHT);
+    placeholder.fill(Qt::darkGray);
+}
+
+SavedVideoModel::~SavedVideoModel()
+{
+    // queued thumbnails refer to this model
+    loader->clear();
+    loader->waitForDone();
+}
+
+void SavedVideoModel::setVideos(const QStringList &names, const QHash<QString, QString> &tooltips)
+{
+    beginResetModel();
+    this->names = names;
+    this->tooltips = tooltips;
+    rows.clear();
+    for (int i = 0; i < names.size(); i++)
+    {
+        rows.insert(names[i], i);
+    }
+    endResetModel();
+}
+
+void SavedVideoModel::addVideo(QString name, QString tooltip)
+{
+    beginInsertRows(QModelIndex(), names.size(), names.size());
+    rows.insert(name, names.size());
+    names << name;
+    if (!tooltip.isEmpty())
+    {
+        tooltips.insert(name, tooltip);
+    }
+    endInsertRows();
+}
+
+int SavedVideoModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : names.size();
+}
+
+QVariant SavedVideoModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= names.size())
+    {
+        return QVariant();
+    }
+    QString name = names[index.row()];
+
+    if (role == Qt::DisplayRole)
+    {
+        return name;
+    }
+    if (role == Qt::ToolTipRole && tooltips.contains(name))
+    {
+        return tooltips[name];
+    }
+    if (role == Qt::DecorationRole)
+    {
+        QPixmap *thumbnail = thumbnails.object(name);
+        if (thumbnail != nullptr)
+        {
+            return *thumbnail;
+        }
+        requestThumbnail(name);
+        return placeholder;
+    }
+    return QVariant();
+}
+
+QString SavedVideoModel::thumbnailPath(QString name)
+{
+    QDir dir(Utilities::getDataPath());
+    dir.mkpath(".thumbs");
+    return dir.absoluteFilePath(".thumbs/" + name + ".jpg");
+}
+
+void SavedVideoModel::requestThumbnail(QString name) const
+{
+    if (pending.contains(name))
+    {
+        return;
+    }
+    pending.insert(name);
+
+    SavedVideoModel *model = const_cast<SavedVideoModel *>(this);
+    loader->start([model, name]()
+                  {
+                      QImage image = loadThumbnail(name);
+                      QMetaObject::invokeMethod(model, "thumbnailLoaded", Qt::QueuedConnection,
+                                                Q_ARG(QString, name), Q_ARG(QImage, image)); });
+}
+
+// Runs on the loader pool
+QImage SavedVideoModel::loadThumbnail(QString name)
+{
+    QString cover = Utilities::getSavedVideoPath(name, "jpg");
+    QString cached = thumbnailPath(name);
+
+    QFileInfo cached_info(cached);
+    if (cached_info.exists() && cached_info.lastModified() >= QFileInfo(cover).lastModified())
+    {
+        QImage image(cached);
+        if (!image.isNull())
+        {
+            return image;
+        }
+    }
+
+    // Let the JPEG decoder scale while decoding instead of decoding the full cover
+    QImageReader reader(cover);
+    QSize size = reader.size();
+    if (size.isValid() && size.height() > THUMBNAIL_HEIGHT)
+    {
+        reader.setScaledSize(QSize(size.width() * THUMBNAIL_HEIGHT / size.height(), THUMBNAIL_HEIGHT));
+    }
+    QImage image = reader.read();
+    if (image.isNull())
+    {
+        qWarning() << "Can't read cover" << cover << reader.errorString();
+        return image;
+    }
+    image.save(cached, "JPG", 80);
+    return image;
+}
+
+void SavedVideoModel::thumbnailLoaded(QString name, QImage image)
+{
+    // broken covers stay pending so that they are not decoded again on every repaint
+    if (image.isNull())
+    {
+        return;
+    }
+    pending.remove(name);
+    if (!rows.contains(name))
+    {
+        return;
+    }
+    thumbnails.insert(name, new QPixmap(QPixmap::fromImage(image)));
+    QModelIndex changed = index(rows[name]);
+    emit dataChanged(changed, changed, QVector<int>() << Qt::DecorationRole);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QCache>
+#include <QPixmap>
+#include <QImage>
+#include <QThreadPool>
+
+/*
+ * List model of saved videos whose cover thumbnails are loaded on demand.
+ * The view only asks for the decoration of rows it paints, a missing
+ * thumbnail is decoded at reduced size on a background pool and shown once
+ * it is ready. Decoded thumbnails are kept in a bounded in-memory cache and
+ * in a .thumbs directory next to the recordings, so the next start doesn't
+ * touch the full-size covers at all.
+ */
+class SavedVideoModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    static const int THUMBNAIL_HEIGHT = 145;
+
+    explicit SavedVideoModel(QObject *parent = nullptr);
+    ~SavedVideoModel();
+
+    void setVideos(const QStringList &names, const QHash<QString, QString> &tooltips);
+    void addVideo(QString name, QString tooltip = "");
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    static QString thumbnailPath(QString name);
+
+private slots:
+    void thumbnailLoaded(QString name, QImage image);
+
+private:
+    void requestThumbnail(QString name) const;
+    static QImage loadThumbnail(QString name);
+
+    QStringList names;
+    QHash<QString, QString> tooltips;
+    QHash<QString, int> rows;
+
+    // data() is const, the caches are filled as a side effect
+    mutable QCache<QString, QPixmap> thumbnails;
+    mutable QSet<QString> pending;
+    QThreadPool *loader;
+    QPixmap placeholder;
+};
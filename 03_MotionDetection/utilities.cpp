@@ -22,13 +22,31 @@ QString Utilities::getDataPath()
     return movie_dir.absoluteFilePath("OpenCV-Qt-App-03-MotionDetection");
 }
 
-QString Utilities::newSavedVideoName()
+QString Utilities::newSavedVideoName(QString source)
 {
     QDateTime time = QDateTime::currentDateTime();
-    return time.toString("yyyy-MM-dd+HH:mm:ss");
+    QString name = time.toString("yyyy-MM-dd+HH:mm:ss");
+    if (!source.isEmpty())
+    {
+        name += "+" + source;
+    }
+    return name;
 }
 
 QString Utilities::getSavedVideoPath(QString name, QString postfix)
 {
     return QString("%1/%2.%3").arg(Utilities::getDataPath(), name, postfix);
 }
+
+// Continuous recording segments are kept apart from the event clips
+QString Utilities::getSegmentsPath()
+{
+    QDir data_dir(Utilities::getDataPath());
+    data_dir.mkpath("segments");
+    return data_dir.absoluteFilePath("segments");
+}
+
+QString Utilities::getSegmentPath(QString name, QString postfix)
+{
+    return QString("%1/%2.%3").arg(Utilities::getSegmentsPath(), name, postfix);
+}
@@ -6,6 +6,8 @@ class Utilities
 {
  public:
     static QString getDataPath();
-    static QString newSavedVideoName();
-    static QString getSavedVideoPath(QString name, QString postfix);x
+    static QString newSavedVideoName(QString source = "");
+    static QString getSavedVideoPath(QString name, QString postfix);
+    static QString getSegmentsPath();
+    static QString getSegmentPath(QString name, QString postfix);
 };
@@ -0,0 +1,654 @@
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QSet>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "utilities.h"
+#include "video_writer_thread.h"
+
+// Segments some writer of this process still writes to, the storage budget never deletes them
+static QMutex open_segments_lock;
+static QSet<QString> open_segments;
+
+VideoWriterThread::VideoWriterThread(int max_queue_size, int sync_interval) : max_queue_size(max_queue_size), sync_interval(sync_interval)
+{
+    queued_frames = 0;
+    codec = MJPG_AVI;
+
+    video_writer = nullptr;
+    raw_file = nullptr;
+    video_name = "";
+    video_path = "";
+    container = "avi";
+    frames_since_sync = 0;
+
+    continuous = false;
+    segment_source = "";
+    segment_fps = 30.0;
+    segment_seconds = 60;
+    segment_start_ms = 0;
+    segment_frames = 0;
+    last_segment_bytes = 0;
+    marker_open = false;
+    marker_part = 0;
+    storage_budget = 0;
+
+    dropped_frames = 0;
+    file_dropped_base = 0;
+    written_frames = 0;
+    total_write_ms = 0.0;
+    max_write_ms = 0.0;
+}
+
+VideoWriterThread::~VideoWriterThread()
+{
+    stop();
+    wait();
+}
+
+void VideoWriterThread::startVideo(QString name, const cv::Mat &cover, double fps, cv::Size size)
+{
+    Task task;
+    task.type = OPEN;
+    task.frame = cover.clone();
+    task.name = name;
+    task.fps = fps;
+    task.size = size;
+    task.time_ms = QDateTime::currentMSecsSinceEpoch();
+    enqueue(task);
+}
+
+// Returns false if the frame was dropped because the queue is full,
+// with wait_if_full the caller blocks instead so that no frame is lost
+bool VideoWriterThread::writeFrame(const cv::Mat &frame, bool wait_if_full, double energy, cv::Rect motion, const cv::Mat &encoded)
+{
+    QMutexLocker locker(&queue_lock);
+    while (wait_if_full && queued_frames >= max_queue_size)
+    {
+        queue_not_full.wait(&queue_lock);
+    }
+    if (queued_frames >= max_queue_size)
+    {
+        dropped_frames++;
+        return false;
+    }
+
+    // The capture loop reuses its buffer, so the queue must own a copy.
+    // Passthrough only needs the compressed bytes, which are much smaller.
+    Task task;
+    task.type = WRITE;
+    if (codec == PASSTHROUGH && !encoded.empty())
+    {
+        task.encoded = encoded.clone();
+    }
+    else
+    {
+        task.frame = frame.clone();
+    }
+    task.time_ms = QDateTime::currentMSecsSinceEpoch();
+    task.energy = energy;
+    task.motion = motion;
+    task.dropped_frames = dropped_frames;
+    tasks.enqueue(task);
+    queued_frames++;
+    queue_not_empty.wakeOne();
+    return true;
+}
+
+void VideoWriterThread::stopVideo()
+{
+    Task task;
+    task.type = CLOSE;
+    enqueue(task);
+}
+
+// Finish everything already queued, then leave the thread loop
+void VideoWriterThread::stop()
+{
+    Task task;
+    task.type = QUIT;
+    enqueue(task);
+}
+
+void VideoWriterThread::startSegments(QString source, double fps, cv::Size size, int segment_seconds)
+{
+    Task task;
+    task.type = SEGMENTS;
+    task.name = source;
+    task.fps = fps;
+    task.size = size;
+    task.segment_seconds = segment_seconds;
+    task.time_ms = QDateTime::currentMSecsSinceEpoch();
+    enqueue(task);
+}
+
+void VideoWriterThread::startMarker(QString name, const cv::Mat &cover)
+{
+    Task task;
+    task.type = MARKER_START;
+    task.name = name;
+    task.frame = cover.clone();
+    task.time_ms = QDateTime::currentMSecsSinceEpoch();
+    enqueue(task);
+}
+
+void VideoWriterThread::stopMarker()
+{
+    Task task;
+    task.type = MARKER_STOP;
+    enqueue(task);
+}
+
+void VideoWriterThread::setCodec(Codec codec)
+{
+    QMutexLocker locker(&queue_lock);
+    this->codec = codec;
+}
+
+void VideoWriterThread::setStorageBudget(qint64 bytes)
+{
+    QMutexLocker locker(&queue_lock);
+    storage_budget = bytes;
+}
+
+VideoWriterThread::Stats VideoWriterThread::stats()
+{
+    QMutexLocker locker(&queue_lock);
+    Stats s;
+    s.queue_depth = queued_frames;
+    s.dropped_frames = dropped_frames - file_dropped_base;
+    s.written_frames = written_frames;
+    s.avg_write_ms = written_frames > 0 ? total_write_ms / written_frames : 0.0;
+    s.max_write_ms = max_write_ms;
+    return s;
+}
+
+void VideoWriterThread::enqueue(const Task &task)
+{
+    // Control tasks are never dropped, only frames are subject to backpressure
+    QMutexLocker locker(&queue_lock);
+    tasks.enqueue(task);
+    tasks.last().dropped_frames = dropped_frames;
+    queue_not_empty.wakeOne();
+}
+
+void VideoWriterThread::run()
+{
+    while (true)
+    {
+        queue_lock.lock();
+        while (tasks.isEmpty())
+        {
+            queue_not_empty.wait(&queue_lock);
+        }
+        Task task = tasks.dequeue();
+        if (task.type == WRITE)
+        {
+            queued_frames--;
+            queue_not_full.wakeAll();
+        }
+        queue_lock.unlock();
+
+        if (task.type == OPEN)
+        {
+            openVideo(task);
+        }
+        else if (task.type == SEGMENTS)
+        {
+            closeVideo();
+            continuous = true;
+            segment_source = task.name;
+            segment_fps = task.fps;
+            segment_size = task.size;
+            segment_seconds = max(1, task.segment_seconds);
+        }
+        else if (task.type == MARKER_START && continuous)
+        {
+            if (!fileOpen())
+            {
+                openSegment(task.time_ms, task.dropped_frames);
+            }
+            // A repeated start belongs to the event that is already open
+            if (!marker_open)
+            {
+                marker_part = 0;
+                openMarker(task.name, task.frame, task.time_ms);
+            }
+        }
+        else if (task.type == MARKER_STOP)
+        {
+            closeMarker();
+        }
+        else if (task.type == WRITE && (fileOpen() || continuous))
+        {
+            QElapsedTimer timer;
+            timer.start();
+            if (continuous && (!fileOpen() || task.time_ms - segment_start_ms >= segment_seconds * 1000LL))
+            {
+                // An event running across the boundary continues as a new part in the next segment
+                QString marker_name = event.name;
+                bool continue_marker = marker_open;
+                closeMarker();
+                closeSegment();
+                openSegment(task.time_ms, task.dropped_frames);
+                if (continue_marker)
+                {
+                    // Passthrough frames only carry their JPEG bytes
+                    cv::Mat cover = task.frame.empty() ? cv::imdecode(task.encoded, cv::IMREAD_COLOR) : task.frame;
+                    marker_part++;
+                    openMarker(QString("%1+part%2").arg(marker_name.section("+part", 0, 0)).arg(marker_part + 1), cover, task.time_ms);
+                }
+            }
+            if (!continuous || marker_open)
+            {
+                indexFrame(task);
+            }
+            writeToFile(task);
+            segment_frames++;
+            if (++frames_since_sync >= sync_interval)
+            {
+                syncToDisk();
+            }
+            double elapsed_ms = timer.nsecsElapsed() / 1e6;
+
+            queue_lock.lock();
+            written_frames++;
+            total_write_ms += elapsed_ms;
+            max_write_ms = max(max_write_ms, elapsed_ms);
+            queue_lock.unlock();
+        }
+        else if (task.type == CLOSE)
+        {
+            closeVideo();
+        }
+        else if (task.type == QUIT)
+        {
+            closeVideo();
+            break;
+        }
+    }
+}
+
+/*
+ * Open the recording file for the current codec, path_base is the path
+ * without extension. Codecs the local OpenCV build can't encode fall back
+ * to MJPG in an AVI container.
+ */
+bool VideoWriterThread::openFile(QString path_base, double fps, cv::Size size)
+{
+    queue_lock.lock();
+    Codec selected = codec;
+    queue_lock.unlock();
+
+    if (selected == PASSTHROUGH)
+    {
+        container = "mjpeg";
+        video_path = path_base + ".mjpeg";
+        raw_file = new QFile(video_path);
+        if (raw_file->open(QIODevice::WriteOnly))
+        {
+            return true;
+        }
+        qWarning() << "Can't open" << video_path << raw_file->errorString();
+        delete raw_file;
+        raw_file = nullptr;
+        selected = MJPG_AVI;
+    }
+
+    int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+    container = "avi";
+    if (selected == H264_MP4)
+    {
+        fourcc = cv::VideoWriter::fourcc('a', 'v', 'c', '1');
+        container = "mp4";
+    }
+    else if (selected == MPEG4_MP4)
+    {
+        fourcc = cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+        container = "mp4";
+    }
+    video_path = path_base + "." + container;
+    video_writer = new cv::VideoWriter(video_path.toStdString(), fourcc, fps, size);
+
+    if (!video_writer->isOpened() && selected != MJPG_AVI)
+    {
+        qWarning() << "Codec not available, recording" << video_path << "as MJPG instead";
+        delete video_writer;
+        QFile::remove(video_path);
+        container = "avi";
+        video_path = path_base + ".avi";
+        video_writer = new cv::VideoWriter(video_path.toStdString(), cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps, size);
+    }
+    return video_writer->isOpened();
+}
+
+void VideoWriterThread::writeToFile(const Task &task)
+{
+    if (raw_file != nullptr)
+    {
+        // Passthrough files are plain concatenated JPEGs, frames without camera bytes are encoded here
+        if (!task.encoded.empty())
+        {
+            raw_file->write((const char *)task.encoded.data, task.encoded.total());
+        }
+        else
+        {
+            vector<uchar> buffer;
+            cv::imencode(".jpg", task.frame, buffer);
+            raw_file->write((const char *)buffer.data(), buffer.size());
+        }
+    }
+    else if (video_writer != nullptr)
+    {
+        // The codec may have changed while passthrough frames were queued
+        video_writer->write(task.frame.empty() ? cv::imdecode(task.encoded, cv::IMREAD_COLOR) : task.frame);
+    }
+}
+
+void VideoWriterThread::closeFile()
+{
+    if (video_writer != nullptr)
+    {
+        video_writer->release();
+        delete video_writer;
+        video_writer = nullptr;
+    }
+    if (raw_file != nullptr)
+    {
+        raw_file->close();
+        delete raw_file;
+        raw_file = nullptr;
+    }
+}
+
+void VideoWriterThread::openVideo(Task &task)
+{
+    // A new recording implicitly finishes the previous one
+    closeVideo();
+
+    video_name = task.name;
+    if (!task.frame.empty())
+    {
+        QString cover = Utilities::getSavedVideoPath(video_name, "jpg");
+        cv::imwrite(cover.toStdString(), task.frame);
+    }
+
+    openFile(Utilities::getDataPath() + "/" + video_name, task.fps, task.size);
+    frames_since_sync = 0;
+
+    event = MotionEvent();
+    event.name = video_name;
+    event.container = container;
+    event.start_ms = event.end_ms = task.time_ms;
+    event.fps = task.fps;
+    resetStats(task.dropped_frames);
+}
+
+// Drops up to dropped_base were counted before the new file was requested and belong to the previous one
+void VideoWriterThread::resetStats(int dropped_base)
+{
+    QMutexLocker locker(&queue_lock);
+    file_dropped_base = dropped_base;
+    written_frames = 0;
+    total_write_ms = 0.0;
+    max_write_ms = 0.0;
+}
+
+void VideoWriterThread::closeVideo()
+{
+    if (continuous)
+    {
+        closeMarker();
+        closeSegment();
+        continuous = false;
+        return;
+    }
+    if (!fileOpen())
+    {
+        return;
+    }
+    closeFile();
+    syncToDisk();
+    EventIndex::append(event);
+
+    Stats s = stats();
+    qDebug() << "video" << video_name << "saved:" << s.written_frames << "frames written,"
+             << s.dropped_frames << "dropped, avg write" << s.avg_write_ms << "ms, max" << s.max_write_ms << "ms";
+    emit videoSaved(video_name);
+}
+
+/*
+ * Called before the frame is written. The first frame of every second of the
+ * clip opens a new timeline bucket, its offset is the file size at that point
+ * (approximate, the encoder may still buffer the previous frame).
+ */
+void VideoWriterThread::indexFrame(const Task &task)
+{
+    int second = max(0, (int)((task.time_ms - event.start_ms) / 1000));
+    while (event.energy.size() <= second)
+    {
+        event.energy.append(0.0);
+        event.keyframes.append(event.first_frame + event.frames);
+        // exact for passthrough files, which are written directly
+        event.offsets.append(raw_file != nullptr ? raw_file->pos() : QFileInfo(video_path).size());
+    }
+    event.energy[second] = max(event.energy[second], task.energy);
+    if (!task.motion.empty())
+    {
+        event.bounds |= QRect(task.motion.x, task.motion.y, task.motion.width, task.motion.height);
+    }
+    event.frames++;
+    event.end_ms = task.time_ms;
+}
+
+/*
+ * Segments are named after the time of their first frame. The file is
+ * preallocated to the expected segment size, so a segment written over a
+ * minute ends up in one contiguous extent instead of many small ones.
+ */
+void VideoWriterThread::openSegment(qint64 time_ms, int dropped_base)
+{
+    video_name = QDateTime::fromMSecsSinceEpoch(time_ms).toString("yyyy-MM-dd+HH:mm:ss");
+    if (!segment_source.isEmpty())
+    {
+        video_name += "+" + segment_source;
+    }
+    openFile(Utilities::getSegmentsPath() + "/" + video_name, segment_fps, segment_size);
+    open_segments_lock.lock();
+    open_segments.insert(video_name);
+    open_segments_lock.unlock();
+    segment_start_ms = time_ms;
+    segment_frames = 0;
+    frames_since_sync = 0;
+
+    // The previous segment is the best estimate, the first one assumes ~10:1 MJPG compression
+    qint64 expected = last_segment_bytes;
+    if (expected <= 0)
+    {
+        expected = (qint64)segment_size.area() * 3 / 10 * (qint64)(segment_fps * segment_seconds);
+    }
+    preallocate(expected);
+    resetStats(dropped_base);
+}
+
+void VideoWriterThread::closeSegment()
+{
+    if (!fileOpen())
+    {
+        return;
+    }
+    closeFile();
+    open_segments_lock.lock();
+    open_segments.remove(video_name);
+    open_segments_lock.unlock();
+
+    // Give back the preallocated space the segment didn't use
+    last_segment_bytes = QFileInfo(video_path).size();
+#ifdef Q_OS_UNIX
+    if (::truncate(video_path.toLocal8Bit().constData(), last_segment_bytes) != 0)
+    {
+        qDebug() << "can't trim preallocated space of" << video_path;
+    }
+#endif
+    syncToDisk();
+
+    Stats s = stats();
+    qDebug() << "segment" << video_name << "closed:" << segment_frames << "frames," << last_segment_bytes << "bytes,"
+             << s.dropped_frames << "dropped";
+    enforceStorageBudget();
+}
+
+// Motion in continuous mode: the event points into the running segment and gets its own cover
+void VideoWriterThread::openMarker(QString name, const cv::Mat &cover, qint64 time_ms)
+{
+    if (marker_open)
+    {
+        return;
+    }
+    event = MotionEvent();
+    event.name = name;
+    event.segment = video_name;
+    event.container = container;
+    event.first_frame = segment_frames;
+    event.start_ms = event.end_ms = time_ms;
+    event.fps = segment_fps;
+    marker_open = true;
+
+    if (!cover.empty())
+    {
+        QString cover_path = Utilities::getSavedVideoPath(name, "jpg");
+        cv::imwrite(cover_path.toStdString(), cover);
+    }
+
+    // Segments with motion are flagged and never deleted by the storage budget
+    QFile flag(Utilities::getSegmentPath(video_name, "keep"));
+    flag.open(QIODevice::WriteOnly);
+}
+
+void VideoWriterThread::closeMarker()
+{
+    if (!marker_open)
+    {
+        return;
+    }
+    marker_open = false;
+    EventIndex::append(event);
+    emit videoSaved(event.name);
+}
+
+void VideoWriterThread::preallocate(qint64 bytes)
+{
+    if (bytes <= 0)
+    {
+        return;
+    }
+#if defined(Q_OS_LINUX)
+    // KEEP_SIZE reserves the blocks without changing the file size the encoder sees
+    int fd = ::open(video_path.toLocal8Bit().constData(), O_WRONLY);
+    if (fd >= 0)
+    {
+        if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, bytes) != 0)
+        {
+            qDebug() << "can't preallocate" << video_path;
+        }
+        ::close(fd);
+    }
+#elif defined(Q_OS_MACOS)
+    int fd = ::open(video_path.toLocal8Bit().constData(), O_WRONLY);
+    if (fd >= 0)
+    {
+        // Try one contiguous extent first, then any extents
+        fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, bytes, 0};
+        if (::fcntl(fd, F_PREALLOCATE, &store) == -1)
+        {
+            store.fst_flags = F_ALLOCATEALL;
+            ::fcntl(fd, F_PREALLOCATE, &store);
+        }
+        ::close(fd);
+    }
+#endif
+}
+
+/*
+ * Delete the oldest segments without motion until all segments fit into the
+ * budget. The segments directory is shared by all sources, so is the budget,
+ * but segments another source is still writing are left alone.
+ */
+void VideoWriterThread::enforceStorageBudget()
+{
+    queue_lock.lock();
+    qint64 budget = storage_budget;
+    queue_lock.unlock();
+    if (budget <= 0)
+    {
+        return;
+    }
+
+    QDir dir(Utilities::getSegmentsPath());
+    QFileInfoList segments = dir.entryInfoList(QStringList() << "*.avi" << "*.mp4" << "*.mjpeg", QDir::Files, QDir::Name);
+    qint64 total = 0;
+    foreach (QFileInfo segment, segments)
+    {
+        total += segment.size();
+    }
+
+    open_segments_lock.lock();
+    QSet<QString> in_use = open_segments;
+    open_segments_lock.unlock();
+    foreach (QFileInfo segment, segments)
+    {
+        if (total <= budget)
+        {
+            break;
+        }
+        if (in_use.contains(segment.completeBaseName()) ||
+            QFile::exists(Utilities::getSegmentPath(segment.completeBaseName(), "keep")))
+        {
+            continue;
+        }
+        if (QFile::remove(segment.absoluteFilePath()))
+        {
+            total -= segment.size();
+            qDebug() << "storage budget: deleted segment" << segment.fileName();
+        }
+    }
+    if (total > budget)
+    {
+        qWarning() << "segments with motion use" << total << "bytes, more than the storage budget of" << budget;
+    }
+}
+
+/*
+ * Push what has been written so far towards the disk, batched every
+ * sync_interval frames. Passthrough files are flushed and synced completely.
+ * The fsync can only reach data cv::VideoWriter has already handed to the
+ * kernel, whatever the encoder still buffers is written when the file is
+ * closed, so for encoded files this bounds the loss but doesn't prevent it.
+ */
+void VideoWriterThread::syncToDisk()
+{
+    frames_since_sync = 0;
+    if (raw_file != nullptr)
+    {
+        raw_file->flush();
+    }
+#ifdef Q_OS_UNIX
+    int fd = ::open(video_path.toLocal8Bit().constData(), O_RDONLY);
+    if (fd >= 0)
+    {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#endif
+
+    Stats s = stats();
+    emit statsChanged(s.queue_depth, s.dropped_frames, s.avg_write_ms);
+}
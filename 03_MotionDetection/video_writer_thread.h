@@ -0,0 +1,165 @@
+#pragma once
+
+#include <QString>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QFile>
+#include "opencv2/opencv.hpp"
+#include "opencv2/videoio.hpp"
+
+#include "event_index.h"
+
+using namespace std;
+
+/*
+ * Encodes and writes recordings on its own thread so that MJPG encoding and
+ * disk stalls never block the capture loop. Frames are handed over through a
+ * bounded queue; when the queue is full new frames are dropped and counted.
+ *
+ * Recordings are either one clip per motion event (startVideo) or continuous
+ * fixed-length segments (startSegments), where motion events are only markers
+ * into the running segment and no extra encoder is started for them.
+ */
+class VideoWriterThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit VideoWriterThread(int max_queue_size = 60, int sync_interval = 30);
+    ~VideoWriterThread();
+
+    // Recording formats. H.264 and MPEG-4 depend on the codecs OpenCV's backend
+    // provides and fall back to MJPG. PASSTHROUGH stores the JPEG frames of an
+    // MJPEG camera as they are, without decoding and re-encoding them.
+    enum Codec
+    {
+        MJPG_AVI,
+        H264_MP4,
+        MPEG4_MP4,
+        PASSTHROUGH
+    };
+    void setCodec(Codec codec); // applies to the next file that is opened
+
+    // Called from the capture thread, these only enqueue work and don't wait for
+    // encoding or disk I/O (except writeFrame() with wait_if_full on a full queue).
+    // energy and motion describe the frame for the event index, encoded holds the
+    // camera's JPEG bytes of the frame if it delivered them.
+    void startVideo(QString name, const cv::Mat &cover, double fps, cv::Size size);
+    bool writeFrame(const cv::Mat &frame, bool wait_if_full = false, double energy = 0.0, cv::Rect motion = cv::Rect(),
+                    const cv::Mat &encoded = cv::Mat());
+    void stopVideo();
+    void stop();
+
+    // Continuous recording, a new segment file is started every segment_seconds
+    void startSegments(QString source, double fps, cv::Size size, int segment_seconds);
+    void startMarker(QString name, const cv::Mat &cover);
+    void stopMarker();
+
+    // Oldest segments without motion markers are deleted once all segments
+    // together exceed this many bytes, 0 keeps everything
+    void setStorageBudget(qint64 bytes);
+
+    // Backpressure metrics
+    struct Stats
+    {
+        int queue_depth;
+        int dropped_frames;
+        int written_frames;
+        double avg_write_ms;
+        double max_write_ms;
+    };
+    Stats stats();
+
+protected:
+    void run() override; // Main loop for encoding and writing queued frames
+
+signals:
+    void videoSaved(QString name);
+    void statsChanged(int queue_depth, int dropped_frames, double avg_write_ms);
+
+private:
+    enum TaskType
+    {
+        OPEN,
+        WRITE,
+        CLOSE,
+        QUIT,
+        SEGMENTS,
+        MARKER_START,
+        MARKER_STOP
+    };
+
+    struct Task
+    {
+        TaskType type;
+        cv::Mat frame;
+        cv::Mat encoded;
+        QString name;
+        double fps;
+        cv::Size size;
+        int segment_seconds;
+        qint64 time_ms; // when the task was queued
+        double energy;
+        cv::Rect motion;
+        int dropped_frames; // drops counted when the task was queued
+    };
+
+    void enqueue(const Task &task);
+    bool openFile(QString path_base, double fps, cv::Size size);
+    void writeToFile(const Task &task);
+    void closeFile();
+    bool fileOpen() const { return video_writer != nullptr || raw_file != nullptr; };
+    void openVideo(Task &task);
+    void closeVideo();
+    void indexFrame(const Task &task);
+    void syncToDisk();
+    void resetStats(int dropped_base);
+
+    void openSegment(qint64 time_ms, int dropped_base);
+    void closeSegment();
+    void openMarker(QString name, const cv::Mat &cover, qint64 time_ms);
+    void closeMarker();
+    void preallocate(qint64 bytes);
+    void enforceStorageBudget();
+
+    QMutex queue_lock;
+    QWaitCondition queue_not_empty;
+    QWaitCondition queue_not_full;
+    QQueue<Task> tasks;
+    int max_queue_size;
+    int queued_frames;
+    Codec codec; // guarded by queue_lock
+
+    // Writer state, only touched by the writer thread
+    cv::VideoWriter *video_writer;
+    QFile *raw_file; // passthrough recordings
+    QString video_name;
+    QString video_path;
+    QString container;
+    int sync_interval;
+    int frames_since_sync;
+    MotionEvent event; // index entry of the open recording
+
+    // Continuous recording state, only touched by the writer thread
+    bool continuous;
+    QString segment_source;
+    double segment_fps;
+    cv::Size segment_size;
+    int segment_seconds;
+    qint64 segment_start_ms;
+    int segment_frames;
+    qint64 last_segment_bytes;
+    bool marker_open;
+    int marker_part;
+    qint64 storage_budget; // guarded by queue_lock
+
+    // Metrics, guarded by queue_lock. Drops are counted for the whole thread
+    // and reported relative to the count when the current file was requested
+    int dropped_frames;
+    int file_dropped_base;
+    int written_frames;
+    double total_write_ms;
+    double max_write_ms;
+};
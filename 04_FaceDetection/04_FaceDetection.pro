@@ -24,7 +24,7 @@ unix: mac {
 DEFINES += OPENCV_DATA_DIR=\\\"/opt/homebrew/share/opencv4/\\\"
 
 # Input
-HEADERS += mainwindow.h capture_thread.h utilities.h
-SOURCES += main.cpp mainwindow.cpp capture_thread.cpp utilities.cpp
+HEADERS += mainwindow.h capture_thread.h utilities.h face_detector.h face_benchmark.h ornament_cache.h model_store.h landmark_model.h photo_encoder.h landmark_filter.h facemark_pool.h
+SOURCES += main.cpp mainwindow.cpp capture_thread.cpp utilities.cpp face_detector.cpp face_benchmark.cpp ornament_cache.cpp model_store.cpp landmark_model.cpp photo_encoder.cpp landmark_filter.cpp facemark_pool.cpp
 
 RESOURCES = images.qrc
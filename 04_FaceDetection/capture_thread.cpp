@@ -1,18 +1,32 @@
 #include <QApplication>
 #include <QImage>
 #include <QTime>
+#include <QElapsedTimer>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
-#include <stdexcept>
 
 #include "utilities.h"
+#include "model_store.h"
 #include "capture_thread.h"
 
 CaptureThread::CaptureThread(int camera, QMutex *lock) : running(false), cameraID(camera), videoPath(""), data_lock(lock)
 {
     frame_width = frame_height = 0;
+    replay_mode = REALTIME;
     taking_photo = false;
+    encoder = new PhotoEncoder(8, this);
+    connect(encoder, &PhotoEncoder::photoSaved, this, &CaptureThread::photoTaken);
+    burst_count = burst_interval_ms = 0;
+    burst_requested = burst_stop_requested = false;
+    burst_left = 0;
+    next_shot_ms = 0;
+    detector = nullptr;
+    detect_interval = 1;
+    analysis_scale = 1.0;
+    min_face_size = max_face_size = 0;
+    smooth_landmarks = true;
+    masks_flag = 0;
 
     loadOrnaments();
 }
@@ -20,7 +34,20 @@ CaptureThread::CaptureThread(int camera, QMutex *lock) : running(false), cameraI
 CaptureThread::CaptureThread(QString videoPath, QMutex *lock) : running(false), cameraID(-1), videoPath(videoPath), data_lock(lock)
 {
     frame_width = frame_height = 0;
+    replay_mode = REALTIME;
     taking_photo = false;
+    encoder = new PhotoEncoder(8, this);
+    connect(encoder, &PhotoEncoder::photoSaved, this, &CaptureThread::photoTaken);
+    burst_count = burst_interval_ms = 0;
+    burst_requested = burst_stop_requested = false;
+    burst_left = 0;
+    next_shot_ms = 0;
+    detector = nullptr;
+    detect_interval = 1;
+    analysis_scale = 1.0;
+    min_face_size = max_face_size = 0;
+    smooth_landmarks = true;
+    masks_flag = 0;
 
     loadOrnaments();
 }
@@ -33,29 +60,46 @@ CaptureThread::~CaptureThread()
 void CaptureThread::run()
 {
     running = true;
-    cv::VideoCapture cap(cameraID);
+    cv::VideoCapture cap;
+    if (videoPath.isEmpty())
+    {
+        cap.open(cameraID);
+    }
+    else
+    {
+        cap.open(videoPath.toStdString());
+    }
     if (!cap.isOpened())
     {
-        std::cerr << "Error opening camera!" << std::endl;
+        std::cerr << "Error opening video source!" << std::endl;
+        running = false;
         return;
     }
 
-    // cv::VideoCapture cap("path/to/video/file");
     cv::Mat tmp_frame;
 
     // Update video frame dimensions
     frame_width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
     frame_height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
 
-    // Face detection
-    classifier = new cv::CascadeClassifier(OPENCV_DATA_DIR "haarcascades/haarcascade_frontalface_default.xml");
-    mark_detector = cv::face::createFacemarkLBF();
-    QString model_path = QApplication::instance()->applicationDirPath() + "/../../../models/lbfmodel.yaml";
-    if (!QFile::exists(model_path))
+    // Face detection, the models are loaded once per process by the model store
+    detector = ModelStore::instance()->checkoutFaceDetector();
+    if (detector == nullptr)
     {
-        throw std::runtime_error("Model file not found: " + model_path.toStdString() + ". Please run the command `curl -O https://raw.githubusercontent.com/kurnianggoro/GSOC2017/master/data/lbfmodel.yaml` and move the downloaded file to the `models` folder.");
+        qWarning() << "Face detection is not available";
     }
-    mark_detector->loadModel(model_path.toStdString());
+
+    // Video files are paced to their own frame rate unless replayed as fast as possible,
+    // cameras and network streams deliver frames at their own pace
+    bool paced = isFileSource() && replay_mode == REALTIME;
+    double source_fps = cap.get(cv::CAP_PROP_FPS);
+    if (source_fps <= 0)
+    {
+        source_fps = 30;
+    }
+    QElapsedTimer replay_clock;
+    replay_clock.start();
+    int frame_count = 0;
 
     while (running)
     {
@@ -64,16 +108,35 @@ void CaptureThread::run()
         {
             break;
         }
-        if (masks_flag > 0)
-            detectFaces(tmp_frame);
+        frame_count++;
+        if (paced)
+        {
+            qint64 ahead_ms = (qint64)(frame_count * 1000.0 / source_fps) - replay_clock.elapsed();
+            if (ahead_ms > 0)
+            {
+                msleep(ahead_ms);
+            }
+        }
+        // Detect once, then draw what was found; photos include the drawn masks
+        if (masks_flag > 0 && detector != nullptr)
+        {
+            // file sources are smoothed on their own time line, which also holds for fast replays
+            double timestamp_s = isFileSource() ? frame_count / source_fps : replay_clock.elapsed() / 1000.0;
+            detectFaces(tmp_frame, timestamp_s);
+            drawFaces(tmp_frame, faces_result);
+        }
+        else if (detector != nullptr)
+        {
+            // Nothing to track while the masks are off
+            faces_result.clear();
+            detector->reset();
+        }
 
-        if (taking_photo)
+        if (taking_photo || burstShotDue())
         {
             takePhoto(tmp_frame);
         }
 
-        detectFaces(tmp_frame);
-
         // Convert frame color from BGR to RGB
         cvtColor(tmp_frame, tmp_frame, cv::COLOR_BGR2RGB);
 
@@ -86,10 +149,23 @@ void CaptureThread::run()
         emit frameCaptured(&frame);
     }
 
+    if (!videoPath.isEmpty())
+    {
+        double elapsed_s = replay_clock.elapsed() / 1000.0;
+        qDebug() << "replayed" << frame_count << "frames of" << videoPath << "in" << elapsed_s << "s,"
+                 << (elapsed_s > 0 ? frame_count / elapsed_s : 0.0) << "fps";
+        if (detector != nullptr)
+        {
+            qDebug() << detector->detectionCount() << "detections," << detector->trackedCount() << "tracked frames,"
+                     << detector->reusedCount() << "fits skipped";
+        }
+    }
+
     // Cleanup
     cap.release();
-    delete classifier;
-    classifier = nullptr;
+    ModelStore::instance()->checkin(detector);
+    detector = nullptr;
+    faces_result.clear();
     running = false;
 }
 
@@ -101,176 +177,150 @@ void CaptureThread::setRunning(bool run)
 
 void CaptureThread::takePhoto(cv::Mat &frame)
 {
-    QString photo_name = Utilities::newPhotoName();
-    QString photo_path = Utilities::getPhotoPath(photo_name, "jpg");
-    cv::imwrite(photo_path.toStdString(), frame);
-    emit photoTaken(photo_name);
+    // encoding and writing happen on the encoder pool, the loop only pays for the copy
+    encoder->submit(frame, Utilities::newPhotoName());
     taking_photo = false;
 }
 
-void CaptureThread::detectFaces(cv::Mat &frame)
+void CaptureThread::startBurst(int count, double rate)
+{
+    burst_count = count;
+    burst_interval_ms = rate > 0 ? (int)(1000 / rate) : 0;
+    burst_requested = true;
+}
+
+// Starts and stops bursts on request and paces their photos
+bool CaptureThread::burstShotDue()
+{
+    if (burst_requested)
+    {
+        burst_requested = false;
+        burst_stop_requested = false;
+        burst_left = burst_count > 0 ? burst_count : -1;
+        burst_clock.start();
+        next_shot_ms = 0;
+        encoder->startBurst();
+    }
+    if (burst_stop_requested)
+    {
+        burst_stop_requested = false;
+        burst_left = 0;
+    }
+    if (burst_left == 0 || burst_clock.elapsed() < next_shot_ms)
+    {
+        return false;
+    }
+
+    // a slow frame does not cause a catch-up series of photos
+    next_shot_ms = qMax(next_shot_ms + burst_interval_ms, burst_clock.elapsed());
+    if (burst_left > 0)
+    {
+        burst_left--;
+    }
+    return true;
+}
+
+void CaptureThread::detectFaces(cv::Mat &frame, double timestamp_s)
 {
-    vector<cv::Rect> faces;
-    cv::Mat gray_frame;
-    cv::cvtColor(frame, gray_frame, cv::COLOR_BGR2GRAY);
-    classifier->detectMultiScale(gray_frame, faces, 1.3, 5);
+    detector->setDetectInterval(detect_interval);
+    detector->setAnalysisScale(analysis_scale);
+    detector->setFaceSizeRange(min_face_size, max_face_size);
+    detector->setSmoothing(smooth_landmarks);
+    detector->update(frame, needsLandmarks(), faces_result, timestamp_s);
+}
 
+void CaptureThread::drawFaces(cv::Mat &frame, const FaceDetectionResult &result)
+{
     cv::Scalar color = cv::Scalar(0, 0, 255); // red
 
     // draw the circumscribe rectangles
     if (isMaskOn(RECTANGLE))
     {
-        for (size_t i = 0; i < faces.size(); i++)
+        for (size_t i = 0; i < result.faces.size(); i++)
         {
-            cv::rectangle(frame, faces[i], color, 1);
+            cv::rectangle(frame, result.faces[i], color, 1);
         }
     }
 
-    vector<vector<cv::Point2f>> shapes;
-    if (mark_detector->fit(frame, faces, shapes))
+    if (!result.hasLandmarks())
     {
-        // Draw facial land marks
-        for (unsigned long i = 0; i < faces.size(); i++)
+        return;
+    }
+    // Draw facial land marks
+    for (size_t i = 0; i < result.faces.size(); i++)
+    {
+        // the fit of this face failed
+        if (result.landmarks[i].empty())
         {
-            if (isMaskOn(LANDMARKS))
+            continue;
+        }
+        if (isMaskOn(LANDMARKS))
+        {
+            for (size_t k = 0; k < result.landmarks[i].size(); k++)
             {
-                for (unsigned long k = 0; k < shapes[i].size(); k++)
-                {
-                    cv::circle(frame, shapes[i][k], 2, color, cv::FILLED);
-                }
+                cv::circle(frame, result.landmarks[i][k], 2, color, cv::FILLED);
             }
-            if (isMaskOn(GLASSES))
-                drawGlasses(frame, shapes[i]);
-            if (isMaskOn(MUSTACHE))
-                drawMustache(frame, shapes[i]);
-            if (isMaskOn(MOUSE_NOSE))
-                drawMouseNose(frame, shapes[i]);
         }
+        if (isMaskOn(GLASSES))
+            drawGlasses(frame, result.landmarks[i]);
+        if (isMaskOn(MUSTACHE))
+            drawMustache(frame, result.landmarks[i]);
+        if (isMaskOn(MOUSE_NOSE))
+            drawMouseNose(frame, result.landmarks[i]);
     }
 }
 
 void CaptureThread::loadOrnaments()
 {
-    QImage image;
-    image.load(":/ornaments/glasses.jpg");
-    image = image.convertToFormat(QImage::Format_RGB888);
-    glasses = cv::Mat(
-                  image.height(), image.width(), CV_8UC3,
-                  image.bits(), image.bytesPerLine())
-                  .clone();
-
-    image.load(":/ornaments/mustache.jpg");
-    image = image.convertToFormat(QImage::Format_RGB888);
-    mustache = cv::Mat(
-                   image.height(), image.width(), CV_8UC3,
-                   image.bits(), image.bytesPerLine())
-                   .clone();
-
-    image.load(":/ornaments/mouse-nose.jpg");
-    image = image.convertToFormat(QImage::Format_RGB888);
-    mouse_nose = cv::Mat(
-                     image.height(), image.width(), CV_8UC3,
-                     image.bits(), image.bytesPerLine())
-                     .clone();
+    const char *paths[3] = {":/ornaments/glasses.jpg", ":/ornaments/mustache.jpg", ":/ornaments/mouse-nose.jpg"};
+    OrnamentCache *caches[3] = {&glasses, &mustache, &mouse_nose};
+    for (int i = 0; i < 3; i++)
+    {
+        QImage image;
+        image.load(paths[i]);
+        image = image.convertToFormat(QImage::Format_RGB888);
+        cv::Mat ornament(image.height(), image.width(), CV_8UC3, image.bits(), image.bytesPerLine());
+
+        // frames are BGR, the cache copies the pixels
+        cv::Mat bgr;
+        cv::cvtColor(ornament, bgr, cv::COLOR_RGB2BGR);
+        caches[i]->setOrnament(bgr);
+    }
 }
 
-void CaptureThread::drawGlasses(cv::Mat &frame, vector<cv::Point2f> &marks)
+void CaptureThread::drawGlasses(cv::Mat &frame, const vector<cv::Point2f> &marks)
 {
-    // resize
-    cv::Mat ornament;
     cv::Point2f left_eye_end = marks[45];
     cv::Point2f right_eye_end = marks[36];
     double distance = cv::norm(left_eye_end - right_eye_end) * 1.5;
-    cv::resize(glasses, ornament, cv::Size(0, 0), distance / glasses.cols, distance / glasses.cols, cv::INTER_NEAREST);
-
-    // rotate
     double angle = -atan((left_eye_end.y - right_eye_end.y) / (left_eye_end.x - right_eye_end.x));
 
-    cv::Point2f center = cv::Point(ornament.cols / 2, ornament.rows / 2);
-    cv::Mat rotateMatrix = cv::getRotationMatrix2D(center, angle * 180 / 3.14, 1.0);
-
-    cv::Mat rotated;
-    cv::warpAffine(
-        ornament, rotated, rotateMatrix, ornament.size(),
-        cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
-
-    // paint
-    center = cv::Point((left_eye_end.x + right_eye_end.x) / 2, (left_eye_end.y + right_eye_end.y) / 2);
-    cv::Rect rec(center.x - rotated.cols / 2, center.y - rotated.rows / 2, rotated.cols, rotated.rows);
-
-    if (rec.x < 0 || rec.y < 0 || (rec.x + rec.width) > frame.cols || (rec.y + rec.height) > frame.rows)
-    {
-        qWarning() << "Invalid painting rectangle!";
-        return;
-    }
-
-    frame(rec) &= rotated;
+    cv::Point2f center = (left_eye_end + right_eye_end) * 0.5;
+    glasses.draw(frame, center, distance, angle * 180 / CV_PI);
 }
 
-void CaptureThread::drawMustache(cv::Mat &frame, vector<cv::Point2f> &marks)
+void CaptureThread::drawMustache(cv::Mat &frame, const vector<cv::Point2f> &marks)
 {
-    // resize
-    cv::Mat ornament;
-    cv::Point2d left_mouth_corner = marks[54];
-    cv::Point2d right_mouth_corner = marks[48];
+    cv::Point2f left_mouth_corner = marks[54];
+    cv::Point2f right_mouth_corner = marks[48];
     double distance = cv::norm(left_mouth_corner - right_mouth_corner) * 1.5;
-    cv::resize(mustache, ornament, cv::Size(0, 0), distance / mustache.cols, distance / mustache.cols, cv::INTER_NEAREST);
-
-    // rotate
     double angle = -atan((left_mouth_corner.y - right_mouth_corner.y) / (left_mouth_corner.x - right_mouth_corner.x));
-    cv::Point2f center = cv::Point(ornament.cols / 2, ornament.rows / 2);
-    cv::Mat rotateMatrix = cv::getRotationMatrix2D(center, angle * 180 / 3.14, 1.0);
-
-    cv::Mat rotated;
-    cv::warpAffine(
-        ornament, rotated, rotateMatrix, ornament.size(),
-        cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
-
-    // paint
-    cv::Point2f nose_bottom = marks[33];
-    cv::Point2f mouth_top = marks[51];
-    center = cv::Point((nose_bottom.x + mouth_top.x) / 2, (nose_bottom.y + mouth_top.y) / 2);
-    cv::Rect rec(center.x - rotated.cols / 2, center.y - rotated.rows / 2, rotated.cols, rotated.rows);
-
-    if (rec.x < 0 || rec.y < 0 || (rec.x + rec.width) > frame.cols || (rec.y + rec.height) > frame.rows)
-    {
-        qWarning() << "Invalid painting rectangle!";
-        return;
-    }
 
-    frame(rec) &= rotated;
+    // between the bottom of the nose and the top of the mouth
+    cv::Point2f center = (marks[33] + marks[51]) * 0.5;
+    mustache.draw(frame, center, distance, angle * 180 / CV_PI);
 }
 
-void CaptureThread::drawMouseNose(cv::Mat &frame, vector<cv::Point2f> &marks)
+void CaptureThread::drawMouseNose(cv::Mat &frame, const vector<cv::Point2f> &marks)
 {
-    // resize
-    cv::Mat ornament;
-    cv::Point2d left_ear_lobe = marks[13];
-    cv::Point2d right_ear_lobe = marks[3];
+    cv::Point2f left_ear_lobe = marks[13];
+    cv::Point2f right_ear_lobe = marks[3];
     double distance = cv::norm(left_ear_lobe - right_ear_lobe);
-    cv::resize(mouse_nose, ornament, cv::Size(0, 0), distance / mouse_nose.cols, distance / mouse_nose.cols, cv::INTER_NEAREST);
 
-    // rotate
-    cv::Point2d left_ear_top = marks[16];
-    cv::Point2d right_ear_top = marks[0];
+    cv::Point2f left_ear_top = marks[16];
+    cv::Point2f right_ear_top = marks[0];
     double angle = -atan((left_ear_top.y - right_ear_top.y) / (left_ear_top.x - right_ear_top.x));
-    cv::Point2f center = cv::Point(ornament.cols / 2, ornament.rows / 2);
-    cv::Mat rotateMatrix = cv::getRotationMatrix2D(center, angle * 180 / 3.14, 1.0);
-
-    cv::Mat rotated;
-    cv::warpAffine(
-        ornament, rotated, rotateMatrix, ornament.size(),
-        cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
-
-    // paint
-    center = marks[30];
-    cv::Rect rec(center.x - rotated.cols / 2, center.y - rotated.rows / 2, rotated.cols, rotated.rows);
-
-    if (rec.x < 0 || rec.y < 0 || (rec.x + rec.width) > frame.cols || (rec.y + rec.height) > frame.rows)
-    {
-        qWarning() << "Invalid painting rectangle!";
-        return;
-    }
 
-    frame(rec) &= rotated;
+    // centered on the tip of the nose
+    mouse_nose.draw(frame, marks[30], distance, angle * 180 / CV_PI);
 }
@@ -3,9 +3,12 @@
 #include <QString>
 #include <QThread>
 #include <QMutex>
+#include <QElapsedTimer>
 #include "opencv2/opencv.hpp"
-#include "opencv2/objdetect.hpp"
-#include "opencv2/face/facemark.hpp"
+
+#include "face_detector.h"
+#include "ornament_cache.h"
+#include "photo_encoder.h"
 
 using namespace std;
 
@@ -23,6 +26,34 @@ public:
     // Setters for thread controls and video capture configurations
     void setRunning(bool run);
     void takePhoto() { taking_photo = true; }
+    // count photos (0 for continuous until stopBurst()) at rate photos per second (0 for every frame)
+    void startBurst(int count, double rate);
+    void stopBurst() { burst_stop_requested = true; };
+    PhotoEncoder::Stats photoStats() { return encoder->stats(); };
+
+    // Pacing of video file sources: REALTIME plays them at their own frame rate,
+    // FAST decodes as fast as possible for offline throughput testing
+    enum ReplayMode
+    {
+        REALTIME,
+        FAST
+    };
+    void setReplayMode(ReplayMode mode) { replay_mode = mode; };
+    bool isFileSource() const { return !videoPath.isEmpty() && !videoPath.contains("://"); };
+
+    // Full face detection every N frames, faces are tracked in between; 1 detects every frame
+    void setDetectInterval(int frames) { detect_interval = frames; };
+    // The cascade runs on a downscaled copy, landmarks are still fitted at full resolution
+    void setAnalysisScale(double scale) { analysis_scale = scale; };
+    // Faces outside this range in full-resolution pixels are ignored, 0 leaves a bound open
+    void setFaceSizeRange(int min_size, int max_size)
+    {
+        min_face_size = min_size;
+        max_face_size = max_size;
+    };
+
+    // One-Euro filtering of the faces and landmarks, steadies the ornaments
+    void setLandmarkSmoothing(bool on) { smooth_landmarks = on; };
 
     enum MASK_TYPE
     {
@@ -53,16 +84,19 @@ protected:
 signals:
     // Signals to notify other Qt components about frame capture, FPS changes, and video saving status
     void frameCaptured(cv::Mat *data);
-    void photoTaken(QString name);
+    void photoTaken(QString name, QImage thumbnail);
 
 private:
     void takePhoto(cv::Mat &frame);
-    void detectFaces(cv::Mat &frame);
+    bool burstShotDue();
+    void detectFaces(cv::Mat &frame, double timestamp_s);
+    void drawFaces(cv::Mat &frame, const FaceDetectionResult &result);
     void loadOrnaments();
-    void drawGlasses(cv::Mat &frame, vector<cv::Point2f> &marks);
-    void drawMustache(cv::Mat &frame, vector<cv::Point2f> &marks);
-    void drawMouseNose(cv::Mat &frame, vector<cv::Point2f> &marks);
+    void drawGlasses(cv::Mat &frame, const vector<cv::Point2f> &marks);
+    void drawMustache(cv::Mat &frame, const vector<cv::Point2f> &marks);
+    void drawMouseNose(cv::Mat &frame, const vector<cv::Point2f> &marks);
     bool isMaskOn(MASK_TYPE type) { return (masks_flag & (1 << type)) != 0; };
+    bool needsLandmarks() { return (masks_flag & ~(1 << RECTANGLE)) != 0; };
 
 private:
     bool running;
@@ -72,17 +106,32 @@ private:
     cv::Mat frame;
 
     int frame_width, frame_height;
+    ReplayMode replay_mode;
 
     // take photos
     bool taking_photo;
-
-    // face detection
-    cv::CascadeClassifier *classifier;
-    cv::Ptr<cv::face::Facemark> mark_detector;
-
-    // mask ornaments
-    cv::Mat glasses;
-    cv::Mat mustache;
-    cv::Mat mouse_nose;
+    PhotoEncoder *encoder;
+
+    // burst requested by the GUI thread, picked up by the capture loop
+    int burst_count;
+    int burst_interval_ms;
+    bool burst_requested, burst_stop_requested;
+    // burst in progress, burst_left is -1 for a continuous one
+    int burst_left;
+    QElapsedTimer burst_clock;
+    qint64 next_shot_ms;
+
+    // face detection, computed once per frame and then rendered
+    FaceDetector *detector;
+    FaceDetectionResult faces_result;
+    int detect_interval;
+    double analysis_scale;
+    int min_face_size, max_face_size;
+    bool smooth_landmarks;
+
+    // mask ornaments, pre-rendered per size and angle
+    OrnamentCache glasses;
+    OrnamentCache mustache;
+    OrnamentCache mouse_nose;
     uint8_t masks_flag;
 };
\ No newline at end of file
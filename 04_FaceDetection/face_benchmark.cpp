@@ -0,0 +1,626 @@
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include "opencv2/opencv.hpp"
+#include "opencv2/videoio.hpp"
+
+#include "landmark_model.h"
+#include "face_detector.h"
+#include "landmark_filter.h"
+#include "face_benchmark.h"
+
+using namespace std;
+
+// Every detector of a benchmark borrows from one pool, as the capture threads do from the model store
+static FacemarkPool marks;
+
+static bool loadDetector(FaceDetector &detector, const string &cascade_path, const QString &model_path)
+{
+    if (marks.size() == 0)
+    {
+        marks.load(model_path.toStdString(), min(cv::getNumThreads(), 4));
+    }
+    detector.setFacemarkPool(&marks);
+    return detector.loadCascade(cascade_path);
+}
+
+struct BenchmarkResolution
+{
+    const char *name;
+    cv::Size size;
+};
+
+// Reference faces found again with an IoU of at least 0.5
+static int matchedFaces(const vector<cv::Rect> &reference, const vector<cv::Rect> &faces)
+{
+    int matched = 0;
+    for (size_t i = 0; i < reference.size(); i++)
+    {
+        for (size_t k = 0; k < faces.size(); k++)
+        {
+            double inter = (reference[i] & faces[k]).area();
+            double uni = reference[i].area() + faces[k].area() - inter;
+            if (uni > 0 && inter / uni >= 0.5)
+            {
+                matched++;
+                break;
+            }
+        }
+    }
+    return matched;
+}
+
+int FaceBenchmark::run(QString videoPath, int max_frames)
+{
+    QString model_path = LandmarkModel::preferredPath();
+    if (!QFile::exists(model_path))
+    {
+        cerr << "Model file not found: " << model_path.toStdString() << endl;
+        return 1;
+    }
+    vector<BenchmarkResolution> resolutions = {{"1080p", cv::Size(1920, 1080)}, {"4K", cv::Size(3840, 2160)}};
+    vector<double> scales = {1.0, 0.5, 0.25};
+
+    cout << "input  scale  frames  faces  wall ms/frame  cpu ms/frame  recall" << endl;
+    for (size_t r = 0; r < resolutions.size(); r++)
+    {
+        // Per-frame faces of the reference scale (full resolution)
+        vector<vector<cv::Rect>> reference;
+
+        for (size_t s = 0; s < scales.size(); s++)
+        {
+            cv::VideoCapture cap(videoPath.toStdString());
+            if (!cap.isOpened())
+            {
+                cerr << "Error opening video file " << videoPath.toStdString() << endl;
+                return 1;
+            }
+
+            FaceDetector detector;
+            if (!loadDetector(detector, OPENCV_DATA_DIR "haarcascades/haarcascade_frontalface_default.xml", model_path))
+            {
+                cerr << "Can't load the face cascade" << endl;
+                return 1;
+            }
+            detector.setAnalysisScale(scales[s]);
+
+            cv::Mat frame, input;
+            FaceDetectionResult result;
+            int64 ticks = 0;
+            clock_t cpu = 0;
+            int frames = 0, faces = 0, reference_faces = 0, matched = 0;
+
+            while (frames < max_frames && cap.read(frame))
+            {
+                cv::resize(frame, input, resolutions[r].size);
+
+                // Only detection and the landmark fit are measured, decoding and resizing are excluded
+                int64 t0 = cv::getTickCount();
+                clock_t c0 = clock();
+                detector.detect(input, true, result);
+                cpu += clock() - c0;
+                ticks += cv::getTickCount() - t0;
+
+                faces += result.faces.size();
+                if (s == 0)
+                {
+                    reference.push_back(result.faces);
+                }
+                else if ((size_t)frames < reference.size())
+                {
+                    reference_faces += reference[frames].size();
+                    matched += matchedFaces(reference[frames], result.faces);
+                }
+                frames++;
+            }
+
+            if (frames == 0)
+            {
+                cerr << "No frames could be read from " << videoPath.toStdString() << endl;
+                return 1;
+            }
+
+            double wall_ms = ticks * 1000.0 / cv::getTickFrequency() / frames;
+            double cpu_ms = cpu * 1000.0 / CLOCKS_PER_SEC / frames;
+            double recall = s == 0 || reference_faces == 0 ? 1.0 : (double)matched / reference_faces;
+            cout << cv::format("%5s  %5.2f  %6d  %5d  %13.2f  %12.2f  %5.1f%%",
+                               resolutions[r].name, scales[s], frames, faces, wall_ms, cpu_ms, recall * 100)
+                 << endl;
+        }
+    }
+    return 0;
+}
+
+// A grid of copies of one face, with the rectangles of all copies
+static cv::Mat groupScene(const cv::Mat &face_image, const cv::Rect &face, int count, vector<cv::Rect> &faces)
+{
+    int cols = (int)ceil(sqrt((double)count));
+    int rows = (count + cols - 1) / cols;
+    cv::Mat scene(face_image.rows * rows, face_image.cols * cols, face_image.type(), cv::Scalar::all(0));
+    faces.clear();
+    for (int i = 0; i < count; i++)
+    {
+        cv::Point offset((i % cols) * face_image.cols, (i / cols) * face_image.rows);
+        face_image.copyTo(scene(cv::Rect(offset, face_image.size())));
+        faces.push_back(face + offset);
+    }
+    return scene;
+}
+
+static double fitMs(FaceDetector &detector, const cv::Mat &scene, const vector<cv::Rect> &faces, int repetitions)
+{
+    FaceDetectionResult result;
+    result.faces = faces;
+    int64 ticks = 0;
+    for (int i = 0; i < repetitions; i++)
+    {
+        int64 t0 = cv::getTickCount();
+        detector.fitLandmarks(scene, result);
+        ticks += cv::getTickCount() - t0;
+    }
+    return ticks * 1000.0 / cv::getTickFrequency() / repetitions;
+}
+
+int FaceBenchmark::runFitScaling(QString path, int repetitions)
+{
+    QString model_path = LandmarkModel::preferredPath();
+    if (!QFile::exists(model_path))
+    {
+        cerr << "Model file not found: " << model_path.toStdString() << endl;
+        return 1;
+    }
+    string cascade_path = OPENCV_DATA_DIR "haarcascades/haarcascade_frontalface_default.xml";
+
+    FaceDetector serial;
+    serial.setFitThreads(1);
+    FaceDetector parallel;
+    if (!loadDetector(serial, cascade_path, model_path) || !loadDetector(parallel, cascade_path, model_path))
+    {
+        cerr << "Can't load the face cascade" << endl;
+        return 1;
+    }
+
+    // The first frame with a face, images are read directly
+    cv::Mat frame = cv::imread(path.toStdString());
+    cv::VideoCapture cap;
+    if (frame.empty())
+    {
+        cap.open(path.toStdString());
+    }
+    FaceDetectionResult result;
+    for (int frames = 0; frames < 300; frames++)
+    {
+        if (frame.empty() && !(cap.isOpened() && cap.read(frame)))
+        {
+            break;
+        }
+        serial.detect(frame, false, result);
+        if (!result.faces.empty() || !cap.isOpened())
+        {
+            break;
+        }
+        frame.release();
+    }
+    if (result.faces.empty())
+    {
+        cerr << "No face found in " << path.toStdString() << endl;
+        return 1;
+    }
+
+    // Each copy leaves room for the margin the fit crops around a face
+    cv::Rect face = result.faces[0];
+    int margin = face.width / 2;
+    cv::Rect tile = cv::Rect(face.x - margin, face.y - margin, face.width + 2 * margin, face.height + 2 * margin) &
+                    cv::Rect(0, 0, frame.cols, frame.rows);
+    cv::Mat face_image = frame(tile).clone();
+    face -= tile.tl();
+
+    cout << "fit threads: " << parallel.fitThreads() << endl;
+    cout << "faces  serial ms  parallel ms  speedup" << endl;
+    int counts[6] = {1, 2, 4, 8, 12, 20};
+    for (int i = 0; i < 6; i++)
+    {
+        vector<cv::Rect> faces;
+        cv::Mat scene = groupScene(face_image, face, counts[i], faces);
+        double serial_ms = fitMs(serial, scene, faces, repetitions);
+        double parallel_ms = fitMs(parallel, scene, faces, repetitions);
+        cout << cv::format("%5d  %9.2f  %11.2f  %6.2fx", counts[i], serial_ms, parallel_ms,
+                           parallel_ms > 0 ? serial_ms / parallel_ms : 0.0)
+             << endl;
+    }
+    return 0;
+}
+
+// A detected face counts as a true positive if it overlaps the box of annotated points this much.
+// The cascade box and the landmark box differ in shape, so this is lower than the usual 0.5
+static const double MIN_MATCH_OVERLAP = 0.4;
+// Faces fitted with a larger NME count as failures, the usual threshold for 300-W
+static const double NME_FAILURE = 0.08;
+
+struct DatasetOptions
+{
+    QString path;
+    QString annotations; // directory of .pts files, empty if there is no ground truth
+    QString csv_path;    // per-frame results, printed to the console if empty
+    double scale_factor;
+    int min_neighbors;
+    double analysis_scale;
+    int max_frames; // 0 reads the whole dataset
+
+    DatasetOptions() : scale_factor(1.3), min_neighbors(5), analysis_scale(1.0), max_frames(0) {}
+};
+
+// Frames of a directory of images in name order, or of a video file
+class DatasetReader
+{
+public:
+    DatasetReader() : next_image(0) {}
+
+    bool open(const QString &path)
+    {
+        QFileInfo info(path);
+        if (info.isDir())
+        {
+            QDir dir(path);
+            QStringList filters;
+            filters << "*.jpg" << "*.jpeg" << "*.png" << "*.bmp";
+            images = dir.entryInfoList(filters, QDir::Files, QDir::Name);
+            next_image = 0;
+            return !images.isEmpty();
+        }
+        return cap.open(path.toStdString());
+    };
+
+    // name is the image name without its extension, or the frame index of a video
+    bool read(cv::Mat &frame, QString &name)
+    {
+        if (cap.isOpened())
+        {
+            name = QString("%1").arg((int)cap.get(cv::CAP_PROP_POS_FRAMES), 6, 10, QChar('0'));
+            return cap.read(frame);
+        }
+        while (next_image < images.size())
+        {
+            QFileInfo image = images[next_image++];
+            frame = cv::imread(image.absoluteFilePath().toStdString());
+            if (!frame.empty())
+            {
+                name = image.completeBaseName();
+                return true;
+            }
+        }
+        return false;
+    };
+
+private:
+    cv::VideoCapture cap;
+    QFileInfoList images;
+    int next_image;
+};
+
+// The points of an iBUG .pts file, empty if it can't be read
+static vector<cv::Point2f> readPts(const QString &path)
+{
+    vector<cv::Point2f> points;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return points;
+    }
+    QTextStream in(&file);
+    bool inside = false;
+    while (!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        if (line == "{")
+        {
+            inside = true;
+        }
+        else if (line == "}")
+        {
+            break;
+        }
+        else if (inside)
+        {
+            QStringList xy = line.split(' ', Qt::SkipEmptyParts);
+            if (xy.size() >= 2)
+            {
+                points.push_back(cv::Point2f(xy[0].toFloat(), xy[1].toFloat()));
+            }
+        }
+    }
+    return points;
+}
+
+// Annotations of one frame are name.pts, further faces name_1.pts, name_2.pts and so on.
+// Returns false if the frame is not annotated at all
+static bool readAnnotations(const QString &dir, const QString &name, vector<vector<cv::Point2f>> &faces)
+{
+    faces.clear();
+    QDir annotations(dir);
+    QString first = annotations.filePath(name + ".pts");
+    bool annotated = QFile::exists(first);
+    if (annotated)
+    {
+        faces.push_back(readPts(first));
+    }
+    for (int i = 1;; i++)
+    {
+        QString path = annotations.filePath(QString("%1_%2.pts").arg(name).arg(i));
+        if (!QFile::exists(path))
+        {
+            break;
+        }
+        annotated = true;
+        faces.push_back(readPts(path));
+    }
+    return annotated;
+}
+
+// Mean point error divided by the distance of the outer eye corners, -1 if it can't be computed
+static double normalizedMeanError(const vector<cv::Point2f> &fitted, const vector<cv::Point2f> &truth)
+{
+    if (truth.size() != 68 || fitted.size() != truth.size())
+    {
+        return -1;
+    }
+    double inter_ocular = cv::norm(truth[36] - truth[45]);
+    if (inter_ocular <= 0)
+    {
+        return -1;
+    }
+    double sum = 0;
+    for (size_t k = 0; k < truth.size(); k++)
+    {
+        sum += cv::norm(fitted[k] - truth[k]);
+    }
+    return sum / truth.size() / inter_ocular;
+}
+
+static double percentile(vector<double> values, double p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    size_t k = min(values.size() - 1, (size_t)(p * values.size()));
+    nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+static double mean(const vector<double> &values)
+{
+    double sum = 0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        sum += values[i];
+    }
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static bool parseDatasetOptions(const QStringList &args, DatasetOptions &options)
+{
+    for (int i = 0; i < args.size(); i++)
+    {
+        bool has_value = i + 1 < args.size();
+        if (args[i] == "--annotations" && has_value)
+        {
+            options.annotations = args[++i];
+        }
+        else if (args[i] == "--csv" && has_value)
+        {
+            options.csv_path = args[++i];
+        }
+        else if (args[i] == "--scale-factor" && has_value)
+        {
+            options.scale_factor = args[++i].toDouble();
+        }
+        else if (args[i] == "--min-neighbors" && has_value)
+        {
+            options.min_neighbors = args[++i].toInt();
+        }
+        else if (args[i] == "--analysis-scale" && has_value)
+        {
+            options.analysis_scale = args[++i].toDouble();
+        }
+        else if (args[i] == "--max-frames" && has_value)
+        {
+            options.max_frames = args[++i].toInt();
+        }
+        else if (options.path.isEmpty() && !args[i].startsWith("--"))
+        {
+            options.path = args[i];
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (options.path.isEmpty() || options.scale_factor <= 1.0 || options.min_neighbors < 0)
+    {
+        return false;
+    }
+    // a directory of images usually keeps its .pts files next to them
+    if (options.annotations.isEmpty() && QFileInfo(options.path).isDir() &&
+        !QDir(options.path).entryList(QStringList() << "*.pts", QDir::Files).isEmpty())
+    {
+        options.annotations = options.path;
+    }
+    return true;
+}
+
+int FaceBenchmark::runDataset(QStringList args)
+{
+    DatasetOptions options;
+    if (!parseDatasetOptions(args, options))
+    {
+        cerr << "usage: 04_FaceDetection --benchmark-dataset path/to/images_or_video [--annotations dir] [--csv file]"
+             << " [--scale-factor 1.3] [--min-neighbors 5] [--analysis-scale 1.0] [--max-frames n]" << endl;
+        return 1;
+    }
+    QString model_path = LandmarkModel::preferredPath();
+    if (!QFile::exists(model_path))
+    {
+        cerr << "Model file not found: " << model_path.toStdString() << endl;
+        return 1;
+    }
+
+    FaceDetector detector;
+    if (!loadDetector(detector, OPENCV_DATA_DIR "haarcascades/haarcascade_frontalface_default.xml", model_path))
+    {
+        cerr << "Can't load the face cascade" << endl;
+        return 1;
+    }
+    detector.setCascadeParameters(options.scale_factor, options.min_neighbors);
+    detector.setAnalysisScale(options.analysis_scale);
+
+    DatasetReader reader;
+    if (!reader.open(options.path))
+    {
+        cerr << "No images or video found at " << options.path.toStdString() << endl;
+        return 1;
+    }
+
+    QFile csv_file(options.csv_path);
+    QTextStream csv(stdout);
+    if (!options.csv_path.isEmpty())
+    {
+        if (!csv_file.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            cerr << "Can't write " << options.csv_path.toStdString() << endl;
+            return 1;
+        }
+        csv.setDevice(&csv_file);
+    }
+    csv << "frame,name,detect_ms,fit_ms,faces,annotated_faces,true_positives,false_positives,mean_nme\n";
+
+    vector<double> detect_ms, fit_ms, nmes;
+    int frames = 0, annotated_frames = 0, faces_found = 0;
+    int true_positives = 0, false_positives = 0, false_negatives = 0;
+    int fit_failures = 0; // matched faces the fit returned no landmarks for
+    cv::Mat frame;
+    QString name;
+    FaceDetectionResult result;
+    vector<vector<cv::Point2f>> truth;
+
+    while ((options.max_frames <= 0 || frames < options.max_frames) && reader.read(frame, name))
+    {
+        // The two stages are timed separately, the cascade settings only affect the first
+        int64 t0 = cv::getTickCount();
+        detector.detect(frame, false, result);
+        int64 t1 = cv::getTickCount();
+        if (!result.faces.empty())
+        {
+            detector.fitLandmarks(frame, result);
+        }
+        int64 t2 = cv::getTickCount();
+        detect_ms.push_back((t1 - t0) * 1000.0 / cv::getTickFrequency());
+        fit_ms.push_back((t2 - t1) * 1000.0 / cv::getTickFrequency());
+        faces_found += result.faces.size();
+
+        QString truth_columns = ",,,";
+        if (!options.annotations.isEmpty() && readAnnotations(options.annotations, name, truth))
+        {
+            annotated_frames++;
+            vector<cv::Rect> truth_boxes;
+            for (size_t k = 0; k < truth.size(); k++)
+            {
+                truth_boxes.push_back(truth[k].empty() ? cv::Rect() : cv::boundingRect(truth[k]));
+            }
+
+            // every detection is matched to at most one annotated face and the other way around
+            vector<int> match = LandmarkFilter::associate(truth_boxes, result.faces, MIN_MATCH_OVERLAP);
+            int matched = 0;
+            vector<double> frame_nmes;
+            for (size_t i = 0; i < match.size(); i++)
+            {
+                if (match[i] < 0)
+                {
+                    continue;
+                }
+                matched++;
+                if (truth[match[i]].size() != 68)
+                {
+                    continue;
+                }
+                if (i >= result.landmarks.size() || result.landmarks[i].empty())
+                {
+                    // a failed fit is a landmark failure, not a face left out of the score
+                    fit_failures++;
+                    continue;
+                }
+                double nme = normalizedMeanError(result.landmarks[i], truth[match[i]]);
+                if (nme >= 0)
+                {
+                    frame_nmes.push_back(nme);
+                }
+            }
+            true_positives += matched;
+            false_positives += (int)result.faces.size() - matched;
+            false_negatives += (int)truth.size() - matched;
+            nmes.insert(nmes.end(), frame_nmes.begin(), frame_nmes.end());
+            truth_columns = QString("%1,%2,%3,%4")
+                                .arg(truth.size())
+                                .arg(matched)
+                                .arg((int)result.faces.size() - matched)
+                                .arg(frame_nmes.empty() ? QString() : QString::number(mean(frame_nmes), 'f', 4));
+        }
+        csv << frames << "," << name << "," << QString::number(detect_ms.back(), 'f', 2) << ","
+            << QString::number(fit_ms.back(), 'f', 2) << "," << result.faces.size() << "," << truth_columns << "\n";
+        frames++;
+    }
+    csv.flush();
+
+    if (frames == 0)
+    {
+        cerr << "No frames could be read from " << options.path.toStdString() << endl;
+        return 1;
+    }
+
+    cout << endl
+         << cv::format("scale factor %.2f, min neighbors %d, analysis scale %.2f",
+                       options.scale_factor, options.min_neighbors, options.analysis_scale)
+         << endl;
+    cout << cv::format("%d frames, %d faces found", frames, faces_found) << endl;
+    cout << "stage    mean ms  median ms  p95 ms" << endl;
+    cout << cv::format("detect  %7.2f  %9.2f  %6.2f", mean(detect_ms), percentile(detect_ms, 0.5), percentile(detect_ms, 0.95)) << endl;
+    cout << cv::format("fit     %7.2f  %9.2f  %6.2f", mean(fit_ms), percentile(fit_ms, 0.5), percentile(fit_ms, 0.95)) << endl;
+
+    if (annotated_frames == 0)
+    {
+        if (!options.annotations.isEmpty())
+        {
+            cout << "no frame has annotations in " << options.annotations.toStdString() << endl;
+        }
+        return 0;
+    }
+    int detections = true_positives + false_positives;
+    int annotated_faces = true_positives + false_negatives;
+    cout << cv::format("%d annotated frames: precision %.1f%%, recall %.1f%% (%d true, %d false positives, %d missed)",
+                       annotated_frames,
+                       detections > 0 ? 100.0 * true_positives / detections : 0.0,
+                       annotated_faces > 0 ? 100.0 * true_positives / annotated_faces : 0.0,
+                       true_positives, false_positives, false_negatives)
+         << endl;
+    if (!nmes.empty() || fit_failures > 0)
+    {
+        // faces without landmarks have no NME of their own but count as failures
+        int failures = fit_failures + (int)count_if(nmes.begin(), nmes.end(), [](double nme)
+                                                    { return nme > NME_FAILURE; });
+        int scored = (int)nmes.size() + fit_failures;
+        cout << cv::format("landmark NME over %d fitted faces: mean %.4f, median %.4f, failures (> %.2f or not fitted) %.1f%% of %d",
+                           (int)nmes.size(), nmes.empty() ? 0.0 : mean(nmes), nmes.empty() ? 0.0 : percentile(nmes, 0.5),
+                           NME_FAILURE, 100.0 * failures / scored, scored)
+             << endl;
+        cout << cv::format("%d matched faces could not be fitted", fit_failures) << endl;
+    }
+    return 0;
+}
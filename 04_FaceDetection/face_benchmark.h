@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+/*
+ * Offline comparison of FaceDetector analysis scales on a recorded video.
+ * Every frame is resized to 1080p and to 4K before it is handed to the
+ * detector, so that one clip covers both camera classes. Full-resolution
+ * detection is the reference; every other scale is scored by how many of
+ * the reference faces it still finds and by how much time it spends per frame.
+ *
+ * runFitScaling() measures how the landmark fit scales with the number of
+ * faces: the first face found in an image or video is tiled into group
+ * scenes of 1 to 20 faces, each fitted on one thread and on the pool.
+ *
+ * runDataset() runs detection and the landmark fit over a directory of images
+ * or a video file with the cascade settings given on the command line. It
+ * reports the time of both stages and the faces found per frame. With iBUG
+ * .pts annotations it also scores precision, recall and the landmark error
+ * normalized by the inter-ocular distance (NME).
+ */
+class FaceBenchmark
+{
+public:
+    static int run(QString videoPath, int max_frames = 200);
+    static int runFitScaling(QString path, int repetitions = 10);
+    // args: path [--annotations dir] [--csv file] [--scale-factor f] [--min-neighbors n]
+    //       [--analysis-scale s] [--max-frames n]
+    static int runDataset(QStringList args);
+};
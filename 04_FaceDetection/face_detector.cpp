@@ -0,0 +1,334 @@
+#include <algorithm>
+
+#include "face_detector.h"
+
+// Points that land further than this from where they started when tracked
+// back to the previous frame are lost
+static const float MAX_FORWARD_BACKWARD_ERROR = 2.0f;
+// A face is lost once fewer than this fraction of its points are still followed
+static const double MIN_TRACKED_FRACTION = 0.6;
+// A detected face keeps its tracked landmarks if it overlaps its tracked
+// rectangle at least this much and moved less than this many face widths
+static const double MIN_REUSE_OVERLAP = 0.7;
+static const float MAX_REUSE_MOTION = 0.02f;
+// after this many detections the landmarks of a face are fitted again anyway
+static const int MAX_REUSED_DETECTIONS = 3;
+
+FaceDetector::FaceDetector() : classifier(nullptr), marks(nullptr)
+{
+    fit_threads = cv::getNumThreads();
+    analysis_scale = 1.0;
+    scale_factor = 1.3;
+    min_neighbors = 5;
+    min_face_size = max_face_size = 0;
+    detect_interval = 1;
+    frames_since_detection = 0;
+    detection_count = tracked_count = reused_count = 0;
+}
+
+FaceDetector::~FaceDetector()
+{
+    delete classifier;
+}
+
+bool FaceDetector::loadCascade(const string &cascade_path)
+{
+    delete classifier;
+    classifier = new cv::CascadeClassifier(cascade_path);
+    return !classifier->empty();
+}
+
+int FaceDetector::fitThreads() const
+{
+    return marks == nullptr ? 0 : max(1, min(fit_threads, marks->size()));
+}
+
+void FaceDetector::detect(const cv::Mat &frame, bool fit_landmarks, FaceDetectionResult &result)
+{
+    result.clear();
+    cv::cvtColor(frame, gray_frame, cv::COLOR_BGR2GRAY);
+    detectCascade(gray_frame, result.faces);
+    detection_count++;
+
+    // The landmark fit is skipped when nothing needs landmarks
+    if (fit_landmarks && !result.faces.empty())
+    {
+        fitLandmarks(frame, result);
+    }
+}
+
+void FaceDetector::detectCascade(const cv::Mat &gray, vector<cv::Rect> &faces)
+{
+    double scale = analysis_scale > 0.0 && analysis_scale < 1.0 ? analysis_scale : 1.0;
+    cv::Size min_size(cvRound(min_face_size * scale), cvRound(min_face_size * scale));
+    cv::Size max_size(cvRound(max_face_size * scale), cvRound(max_face_size * scale));
+    if (scale == 1.0)
+    {
+        classifier->detectMultiScale(gray, faces, scale_factor, min_neighbors, 0, min_size, max_size);
+        return;
+    }
+
+    cv::resize(gray, small_gray, cv::Size(), scale, scale, cv::INTER_AREA);
+    classifier->detectMultiScale(small_gray, faces, scale_factor, min_neighbors, 0, min_size, max_size);
+    for (size_t i = 0; i < faces.size(); i++)
+    {
+        faces[i] = cv::Rect(cvRound(faces[i].x / scale), cvRound(faces[i].y / scale),
+                            cvRound(faces[i].width / scale), cvRound(faces[i].height / scale));
+    }
+}
+
+// Fits all faces of the result, in parallel if there are several
+bool FaceDetector::fitLandmarks(const cv::Mat &frame, FaceDetectionResult &result)
+{
+    int count = (int)result.faces.size();
+    result.landmarks.assign(count, vector<cv::Point2f>());
+    vector<uchar> fitted(count, 0);
+    if (fitThreads() == 0)
+    {
+        return false;
+    }
+
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range)
+                      {
+                          for (int i = range.start; i < range.end; i++)
+                          {
+                              fitted[i] = fitFace(frame, result.faces[i], result.landmarks[i]);
+                          } }, (double)fitThreads());
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!fitted[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Facemark converts the whole image it is given, so each face is fitted on a crop of its own
+bool FaceDetector::fitFace(const cv::Mat &frame, const cv::Rect &face, vector<cv::Point2f> &landmarks)
+{
+    // the jaw line and the brows reach a little beyond the cascade rectangle
+    int margin = face.width / 4;
+    cv::Rect crop = cv::Rect(face.x - margin, face.y - margin, face.width + 2 * margin, face.height + 2 * margin) &
+                    cv::Rect(0, 0, frame.cols, frame.rows);
+    if (crop.empty())
+    {
+        return false;
+    }
+
+    // other detectors may be fitting too, then this waits for an instance
+    cv::Ptr<cv::face::Facemark> mark = marks->acquire();
+    vector<cv::Rect> crop_faces(1, face - crop.tl());
+    vector<vector<cv::Point2f>> crop_landmarks;
+    bool ok = mark->fit(frame(crop), crop_faces, crop_landmarks) && !crop_landmarks.empty();
+    marks->release(mark);
+    if (!ok)
+    {
+        return false;
+    }
+
+    landmarks = crop_landmarks[0];
+    for (size_t k = 0; k < landmarks.size(); k++)
+    {
+        landmarks[k] += cv::Point2f(crop.x, crop.y);
+    }
+    return true;
+}
+
+// Detects every detect_interval frames and tracks the last result in between
+void FaceDetector::update(const cv::Mat &frame, bool fit_landmarks, FaceDetectionResult &result, double timestamp_s)
+{
+    bool due = detect_interval <= 1 || frames_since_detection + 1 >= detect_interval || prev_gray.empty();
+    // Landmarks were just switched on but the tracked faces have none yet
+    bool missing_landmarks = fit_landmarks && !current.faces.empty() && !current.hasLandmarks();
+
+    // Detection frames are tracked too, a face that held still need not be fitted again
+    bool tracked = false;
+    if (!prev_gray.empty() && !missing_landmarks)
+    {
+        cv::cvtColor(frame, gray_frame, cv::COLOR_BGR2GRAY);
+        tracked = track(current);
+    }
+
+    if (tracked && !due)
+    {
+        frames_since_detection++;
+        tracked_count++;
+        cv::swap(prev_gray, gray_frame);
+    }
+    else
+    {
+        redetect(frame, fit_landmarks, tracked);
+        frames_since_detection = 0;
+        if (detect_interval > 1)
+        {
+            resetTracks(current);
+            cv::swap(prev_gray, gray_frame);
+        }
+        else
+        {
+            prev_gray.release();
+        }
+    }
+
+    result = current;
+    filter.apply(result.faces, result.landmarks, result.ids, timestamp_s);
+}
+
+// Runs the cascade and fits the faces that can't keep the landmarks they were tracked with
+void FaceDetector::redetect(const cv::Mat &frame, bool fit_landmarks, bool tracked)
+{
+    FaceDetectionResult previous;
+    vector<int> previous_ages;
+    swap(previous, current);
+    fit_ages.swap(previous_ages);
+
+    detect(frame, false, current);
+    int count = (int)current.faces.size();
+    fit_ages.assign(count, 0);
+    if (!fit_landmarks || count == 0)
+    {
+        return;
+    }
+
+    vector<int> match(count, -1);
+    if (tracked && previous.hasLandmarks())
+    {
+        match = LandmarkFilter::associate(previous.faces, current.faces, MIN_REUSE_OVERLAP);
+    }
+
+    FaceDetectionResult to_fit;
+    vector<int> fit_index;
+    current.landmarks.assign(count, vector<cv::Point2f>());
+    for (int i = 0; i < count; i++)
+    {
+        int j = match[i];
+        if (j >= 0 && !previous.landmarks[j].empty() && face_motion[j] <= MAX_REUSE_MOTION &&
+            previous_ages[j] + 1 < MAX_REUSED_DETECTIONS)
+        {
+            current.landmarks[i].swap(previous.landmarks[j]);
+            fit_ages[i] = previous_ages[j] + 1;
+            reused_count++;
+        }
+        else
+        {
+            to_fit.faces.push_back(current.faces[i]);
+            fit_index.push_back(i);
+        }
+    }
+
+    if (!to_fit.faces.empty())
+    {
+        // a face that failed stays without landmarks and is fitted again on the next detection
+        fitLandmarks(frame, to_fit);
+        for (size_t k = 0; k < fit_index.size(); k++)
+        {
+            current.landmarks[fit_index[k]].swap(to_fit.landmarks[k]);
+        }
+    }
+}
+
+void FaceDetector::reset()
+{
+    prev_gray.release();
+    track_points.clear();
+    face_motion.clear();
+    frames_since_detection = 0;
+    current.clear();
+    fit_ages.clear();
+    filter.reset();
+}
+
+// Picks the points to follow until the next detection
+void FaceDetector::resetTracks(const FaceDetectionResult &result)
+{
+    track_points.assign(result.faces.size(), vector<cv::Point2f>());
+    for (size_t i = 0; i < result.faces.size(); i++)
+    {
+        if (result.hasLandmarks() && !result.landmarks[i].empty())
+        {
+            track_points[i] = result.landmarks[i];
+            continue;
+        }
+        cv::Rect face = result.faces[i] & cv::Rect(0, 0, gray_frame.cols, gray_frame.rows);
+        if (face.empty())
+        {
+            continue;
+        }
+        cv::goodFeaturesToTrack(gray_frame(face), track_points[i], 30, 0.01, face.width / 20.0);
+        for (size_t k = 0; k < track_points[i].size(); k++)
+        {
+            track_points[i][k] += cv::Point2f(face.x, face.y);
+        }
+    }
+}
+
+// Moves the faces of the previous frame to gray_frame, false if any face was lost
+bool FaceDetector::track(FaceDetectionResult &result)
+{
+    if (result.faces.empty())
+    {
+        result.tracked = true;
+        return true;
+    }
+
+    vector<cv::Point2f> points, forward, backward;
+    for (size_t i = 0; i < track_points.size(); i++)
+    {
+        points.insert(points.end(), track_points[i].begin(), track_points[i].end());
+    }
+    if (points.empty())
+    {
+        return false;
+    }
+
+    vector<uchar> forward_status, backward_status;
+    vector<float> errors;
+    cv::Size window(21, 21);
+    cv::calcOpticalFlowPyrLK(prev_gray, gray_frame, points, forward, forward_status, errors, window, 3);
+    cv::calcOpticalFlowPyrLK(gray_frame, prev_gray, forward, backward, backward_status, errors, window, 3);
+
+    size_t offset = 0;
+    face_motion.assign(result.faces.size(), 0.0f);
+    for (size_t i = 0; i < result.faces.size(); i++)
+    {
+        vector<cv::Point2f> &face_points = track_points[i];
+        vector<float> dx, dy;
+        vector<bool> good(face_points.size());
+        for (size_t k = 0; k < face_points.size(); k++)
+        {
+            size_t p = offset + k;
+            good[k] = forward_status[p] && backward_status[p] &&
+                      cv::norm(backward[p] - points[p]) <= MAX_FORWARD_BACKWARD_ERROR;
+            if (good[k])
+            {
+                dx.push_back(forward[p].x - points[p].x);
+                dy.push_back(forward[p].y - points[p].y);
+            }
+        }
+        if (face_points.empty() || dx.size() < face_points.size() * MIN_TRACKED_FRACTION)
+        {
+            return false;
+        }
+
+        // The median motion of the face moves the rectangle and the points that were not followed
+        nth_element(dx.begin(), dx.begin() + dx.size() / 2, dx.end());
+        nth_element(dy.begin(), dy.begin() + dy.size() / 2, dy.end());
+        cv::Point2f shift(dx[dx.size() / 2], dy[dy.size() / 2]);
+        face_motion[i] = (float)(cv::norm(shift) / max(result.faces[i].width, 1));
+        for (size_t k = 0; k < face_points.size(); k++)
+        {
+            face_points[k] = good[k] ? forward[offset + k] : face_points[k] + shift;
+        }
+        result.faces[i].x += cvRound(shift.x);
+        result.faces[i].y += cvRound(shift.y);
+        if (result.hasLandmarks() && !result.landmarks[i].empty())
+        {
+            result.landmarks[i] = face_points;
+        }
+        offset += face_points.size();
+    }
+    result.tracked = true;
+    return true;
+}
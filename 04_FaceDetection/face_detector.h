@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "opencv2/objdetect.hpp"
+
+#include "facemark_pool.h"
+#include "landmark_filter.h"
+
+using namespace std;
+
+// Faces and their 68 facial landmarks found in one frame
+struct FaceDetectionResult
+{
+    vector<cv::Rect> faces;
+    vector<vector<cv::Point2f>> landmarks; // one set per face, empty if not fitted
+    vector<int> ids; // per face, the same face keeps its id from frame to frame
+    bool tracked; // true if carried over from the previous frame instead of detected
+
+    FaceDetectionResult() : tracked(false) {}
+    bool hasLandmarks() const { return !faces.empty() && landmarks.size() == faces.size(); };
+    void clear()
+    {
+        faces.clear();
+        landmarks.clear();
+        ids.clear();
+        tracked = false;
+    };
+};
+
+/*
+ * Haar cascade face detection plus LBF landmark fitting. Detection never
+ * draws on the frame, rendering is a separate stage that consumes the result.
+ *
+ * With a detect interval above 1, update() runs the full detection only every
+ * N frames and in between follows the faces with pyramidal Lucas-Kanade
+ * optical flow: on the landmarks if they are fitted, otherwise on corners
+ * found inside each face rectangle. Points are tracked forward and back, a
+ * face whose points do not come back to where they started has been lost and
+ * the next frame is detected again right away. On a detection frame, a face
+ * that was tracked with little motion and still matches what the cascade
+ * finds keeps its tracked landmarks for a few detections instead of being
+ * fitted again.
+ *
+ * update() hands out the faces after a One-Euro filter per face that steadies
+ * the landmarks and the ornaments drawn on them. The tracking itself always
+ * continues from the unfiltered shapes.
+ *
+ * The cascade can run on a downscaled copy of the frame, and the faces it finds
+ * are mapped back to full resolution. The landmark fit always works on the
+ * full-resolution frame, but only on a crop around each face. With several
+ * faces the crops are fitted in parallel on OpenCV's thread pool. A Facemark
+ * instance keeps per-fit state and is not reentrant, so every concurrent fit
+ * borrows an instance of its own from a FacemarkPool that all detectors of the
+ * process share. A face whose fit fails is left without landmarks, the other
+ * faces keep theirs.
+ */
+class FaceDetector
+{
+public:
+    FaceDetector();
+    ~FaceDetector();
+
+    bool loadCascade(const string &cascade_path);
+    // The pool is not owned and must outlive the detector
+    void setFacemarkPool(FacemarkPool *pool) { marks = pool; };
+    void detect(const cv::Mat &frame, bool fit_landmarks, FaceDetectionResult &result);
+    // timestamp_s is the time of the frame in the stream, it paces the smoothing
+    void update(const cv::Mat &frame, bool fit_landmarks, FaceDetectionResult &result, double timestamp_s);
+    // false if any face could not be fitted, its landmarks are left empty
+    bool fitLandmarks(const cv::Mat &frame, FaceDetectionResult &result);
+    void reset(); // the next update() detects, e.g. after frames were skipped
+    void resetCounts() { detection_count = tracked_count = reused_count = 0; };
+
+    // Most faces of one frame fitted at the same time, never more than the pool has instances
+    void setFitThreads(int threads) { fit_threads = threads; };
+    int fitThreads() const;
+    void setDetectInterval(int frames) { detect_interval = frames; };
+    void setAnalysisScale(double scale) { analysis_scale = scale; };
+    // detectMultiScale() step between scales and neighbors needed to keep a face
+    void setCascadeParameters(double factor, int neighbors)
+    {
+        scale_factor = factor;
+        min_neighbors = neighbors;
+    };
+    // in full-resolution pixels, 0 leaves the size unbounded
+    void setFaceSizeRange(int min_size, int max_size)
+    {
+        min_face_size = min_size;
+        max_face_size = max_size;
+    };
+    int detectionCount() const { return detection_count; };
+    int trackedCount() const { return tracked_count; };
+    void setSmoothing(bool on) { filter.setSmoothing(on); };
+    // faces that kept their tracked landmarks on a detection frame
+    int reusedCount() const { return reused_count; };
+
+private:
+    void redetect(const cv::Mat &frame, bool fit_landmarks, bool tracked);
+    void detectCascade(const cv::Mat &frame, vector<cv::Rect> &faces);
+    bool fitFace(const cv::Mat &frame, const cv::Rect &face, vector<cv::Point2f> &landmarks);
+    bool track(FaceDetectionResult &result);
+    void resetTracks(const FaceDetectionResult &result);
+
+private:
+    cv::CascadeClassifier *classifier;
+    FacemarkPool *marks;
+    int fit_threads;
+    cv::Mat gray_frame;
+    cv::Mat small_gray;
+    double analysis_scale;
+    double scale_factor;
+    int min_neighbors;
+    int min_face_size, max_face_size;
+
+    // tracking between detections
+    int detect_interval; // 1 detects every frame
+    int frames_since_detection;
+    cv::Mat prev_gray;
+    vector<vector<cv::Point2f>> track_points; // per face, the landmarks or corners inside the face
+    vector<float> face_motion; // per face, the last tracked motion in face widths
+    int detection_count, tracked_count;
+
+    // unfiltered faces, what tracking continues from
+    FaceDetectionResult current;
+    vector<int> fit_ages; // per face of current, detections since its landmarks were fitted
+    int reused_count;
+    LandmarkFilter filter;
+};
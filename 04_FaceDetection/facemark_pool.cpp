@@ -0,0 +1,44 @@
+#include "facemark_pool.h"
+
+void FacemarkPool::load(const string &model_path, int count)
+{
+    // the instances parse the model file concurrently, loading takes about as long as loading one
+    count = max(count, 1);
+    vector<cv::Ptr<cv::face::Facemark>> loaded(count);
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range)
+                      {
+                          for (int i = range.start; i < range.end; i++)
+                          {
+                              loaded[i] = cv::face::createFacemarkLBF();
+                              loaded[i]->loadModel(model_path);
+                          } });
+
+    std::lock_guard<std::mutex> locker(lock);
+    instances = loaded;
+    free_instances = loaded;
+}
+
+cv::Ptr<cv::face::Facemark> FacemarkPool::acquire()
+{
+    std::unique_lock<std::mutex> locker(lock);
+    if (instances.empty())
+    {
+        return cv::Ptr<cv::face::Facemark>();
+    }
+    while (free_instances.empty())
+    {
+        released.wait(locker);
+    }
+    cv::Ptr<cv::face::Facemark> instance = free_instances.back();
+    free_instances.pop_back();
+    return instance;
+}
+
+void FacemarkPool::release(const cv::Ptr<cv::face::Facemark> &instance)
+{
+    {
+        std::lock_guard<std::mutex> locker(lock);
+        free_instances.push_back(instance);
+    }
+    released.notify_one();
+}
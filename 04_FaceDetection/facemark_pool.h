@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "opencv2/opencv.hpp"
+#include "opencv2/face/facemark.hpp"
+
+using namespace std;
+
+/*
+ * LBF Facemark instances shared by all face detectors of the process. Every
+ * instance holds a full copy of the landmark model and keeps state while it
+ * fits, so it can fit one face at a time. The pool therefore has as many
+ * instances as fits may run at once, however many detectors borrow from it.
+ */
+class FacemarkPool
+{
+public:
+    // throws cv::Exception if the model can't be parsed
+    void load(const string &model_path, int count);
+    int size() const { return (int)instances.size(); };
+
+    // Blocks until an instance is free, an empty pointer if nothing is loaded
+    cv::Ptr<cv::face::Facemark> acquire();
+    void release(const cv::Ptr<cv::face::Facemark> &instance);
+
+private:
+    vector<cv::Ptr<cv::face::Facemark>> instances;
+    vector<cv::Ptr<cv::face::Facemark>> free_instances;
+    std::mutex lock;
+    std::condition_variable released;
+};
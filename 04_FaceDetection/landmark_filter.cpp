@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+
+#include "landmark_filter.h"
+
+// Faces whose rectangles overlap less than this in consecutive frames are different faces
+static const double MIN_ASSOCIATION_OVERLAP = 0.3;
+// Cutoff of the speed estimate itself, in Hz
+static const double SPEED_CUTOFF = 1.0;
+// Used when the timestamps do not advance, e.g. on the first frame
+static const double DEFAULT_FRAME_TIME = 1.0 / 30;
+
+static double smoothingFactor(double cutoff, double dt)
+{
+    double tau = 1.0 / (2 * CV_PI * cutoff);
+    return 1.0 / (1.0 + tau / dt);
+}
+
+float OneEuroFilter::filter(float x, double dt, double speed_scale, double min_cutoff, double beta)
+{
+    if (!initialized)
+    {
+        value = x;
+        speed = 0;
+        initialized = true;
+        return x;
+    }
+
+    float raw_speed = (float)((x - value) / dt);
+    speed += (float)(smoothingFactor(SPEED_CUTOFF, dt) * (raw_speed - speed));
+    double cutoff = min_cutoff + beta * fabs(speed) / speed_scale;
+    value += (float)(smoothingFactor(cutoff, dt) * (x - value));
+    return value;
+}
+
+LandmarkFilter::LandmarkFilter()
+{
+    next_id = 0;
+    last_timestamp = -1;
+    smoothing = true;
+    min_cutoff = 1.0;
+    beta = 5.0;
+}
+
+void LandmarkFilter::reset()
+{
+    tracks.clear();
+    last_timestamp = -1;
+}
+
+double LandmarkFilter::overlap(const cv::Rect &a, const cv::Rect &b)
+{
+    double intersection = (a & b).area();
+    double united = a.area() + b.area() - intersection;
+    return united > 0 ? intersection / united : 0.0;
+}
+
+// Greedy on the largest overlaps first, a handful of faces doesn't need an optimal assignment
+vector<int> LandmarkFilter::associate(const vector<cv::Rect> &prev, const vector<cv::Rect> &next, double min_overlap)
+{
+    vector<pair<double, pair<int, int>>> candidates;
+    for (size_t i = 0; i < next.size(); i++)
+    {
+        for (size_t j = 0; j < prev.size(); j++)
+        {
+            double o = overlap(next[i], prev[j]);
+            if (o >= min_overlap)
+            {
+                candidates.push_back(make_pair(o, make_pair((int)i, (int)j)));
+            }
+        }
+    }
+    sort(candidates.begin(), candidates.end(),
+         [](const pair<double, pair<int, int>> &a, const pair<double, pair<int, int>> &b)
+         {
+             return a.first > b.first;
+         });
+
+    vector<int> match(next.size(), -1);
+    vector<bool> taken(prev.size(), false);
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        int i = candidates[c].second.first;
+        int j = candidates[c].second.second;
+        if (match[i] < 0 && !taken[j])
+        {
+            match[i] = j;
+            taken[j] = true;
+        }
+    }
+    return match;
+}
+
+void LandmarkFilter::apply(vector<cv::Rect> &faces, vector<vector<cv::Point2f>> &landmarks, vector<int> &ids, double timestamp_s)
+{
+    double dt = last_timestamp >= 0 && timestamp_s > last_timestamp ? timestamp_s - last_timestamp : DEFAULT_FRAME_TIME;
+    last_timestamp = timestamp_s;
+
+    vector<cv::Rect> prev_faces;
+    for (size_t j = 0; j < tracks.size(); j++)
+    {
+        prev_faces.push_back(tracks[j].face);
+    }
+    vector<int> match = associate(prev_faces, faces, MIN_ASSOCIATION_OVERLAP);
+
+    bool has_landmarks = !faces.empty() && landmarks.size() == faces.size();
+    vector<FaceTrack> next_tracks(faces.size());
+    ids.assign(faces.size(), -1);
+    for (size_t i = 0; i < faces.size(); i++)
+    {
+        FaceTrack &track = next_tracks[i];
+        if (match[i] >= 0)
+        {
+            track = std::move(tracks[match[i]]);
+        }
+        else
+        {
+            track.id = next_id++;
+        }
+        track.face = faces[i];
+        ids[i] = track.id;
+
+        if (!smoothing)
+        {
+            // start over from the raw values once smoothing is switched back on
+            for (int k = 0; k < 4; k++)
+            {
+                track.box[k].reset();
+            }
+            track.points.clear();
+            continue;
+        }
+
+        double width = max(faces[i].width, 1);
+        float box[4] = {(float)faces[i].x, (float)faces[i].y, (float)faces[i].width, (float)faces[i].height};
+        for (int k = 0; k < 4; k++)
+        {
+            box[k] = track.box[k].filter(box[k], dt, width, min_cutoff, beta);
+        }
+        faces[i] = cv::Rect(cvRound(box[0]), cvRound(box[1]), cvRound(box[2]), cvRound(box[3]));
+
+        if (!has_landmarks || landmarks[i].empty())
+        {
+            track.points.clear();
+            continue;
+        }
+        vector<cv::Point2f> &marks = landmarks[i];
+        if (track.points.size() != marks.size() * 2)
+        {
+            track.points.assign(marks.size() * 2, OneEuroFilter());
+        }
+        for (size_t k = 0; k < marks.size(); k++)
+        {
+            marks[k].x = track.points[2 * k].filter(marks[k].x, dt, width, min_cutoff, beta);
+            marks[k].y = track.points[2 * k + 1].filter(marks[k].y, dt, width, min_cutoff, beta);
+        }
+    }
+    tracks.swap(next_tracks);
+}
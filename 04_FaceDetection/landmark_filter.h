@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+using namespace std;
+
+// Low-pass filter whose cutoff frequency rises with the speed of the signal:
+// jitter of a still face is smoothed heavily, real motion passes with little lag
+class OneEuroFilter
+{
+public:
+    OneEuroFilter() : initialized(false), value(0), speed(0) {}
+
+    // speed_scale converts the speed into the units beta is tuned for
+    float filter(float x, double dt, double speed_scale, double min_cutoff, double beta);
+    void reset() { initialized = false; };
+
+private:
+    bool initialized;
+    float value, speed;
+};
+
+/*
+ * Temporal smoothing of the faces found in consecutive frames. Faces are
+ * associated with the faces of the previous frame by the overlap of their
+ * rectangles: a face that continues keeps its id and its filters, a face that
+ * appears gets a new id, and a face that disappears is forgotten.
+ *
+ * Every landmark coordinate and the rectangle go through a One-Euro filter.
+ * Speeds are measured in face widths per second, so the same settings work
+ * for near and far faces.
+ */
+class LandmarkFilter
+{
+public:
+    LandmarkFilter();
+
+    // Smooths faces and landmarks in place, ids receives the id of every face
+    void apply(vector<cv::Rect> &faces, vector<vector<cv::Point2f>> &landmarks, vector<int> &ids, double timestamp_s);
+    void reset();
+
+    void setSmoothing(bool on) { smoothing = on; };
+    bool isSmoothing() const { return smoothing; };
+    // min_cutoff in Hz sets the smoothing at rest, beta how quickly it gives way to motion
+    void setParameters(double min_cutoff, double beta)
+    {
+        this->min_cutoff = min_cutoff;
+        this->beta = beta;
+    };
+
+    static double overlap(const cv::Rect &a, const cv::Rect &b);
+    // For each face in next, the index of the face in prev it continues, -1 for a new face
+    static vector<int> associate(const vector<cv::Rect> &prev, const vector<cv::Rect> &next, double min_overlap);
+
+private:
+    struct FaceTrack
+    {
+        int id;
+        cv::Rect face; // unfiltered, what the next frame is associated with
+        OneEuroFilter box[4];
+        vector<OneEuroFilter> points; // x and y of every landmark
+    };
+
+    vector<FaceTrack> tracks;
+    int next_id;
+    double last_timestamp;
+    bool smoothing;
+    double min_cutoff, beta;
+};
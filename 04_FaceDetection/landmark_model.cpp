@@ -0,0 +1,137 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <string>
+#include "opencv2/opencv.hpp"
+#include "opencv2/face/facemark.hpp"
+
+#include "utilities.h"
+#include "landmark_model.h"
+
+using namespace std;
+
+QString LandmarkModel::textPath()
+{
+    return Utilities::getLandmarkModelPath();
+}
+
+QString LandmarkModel::binaryPath()
+{
+    QFileInfo text(textPath());
+    return text.absolutePath() + "/" + text.completeBaseName() + ".base64.yml";
+}
+
+bool LandmarkModel::isConverted()
+{
+    QFileInfo binary(binaryPath());
+    QFileInfo text(textPath());
+    return binary.exists() && (!text.exists() || binary.lastModified() >= text.lastModified());
+}
+
+QString LandmarkModel::preferredPath()
+{
+    return isConverted() ? binaryPath() : textPath();
+}
+
+// Matrices are maps with rows, cols, dt and data
+static bool isMatrix(const cv::FileNode &node)
+{
+    return node.isMap() && !node["rows"].empty() && !node["cols"].empty() && !node["dt"].empty() && !node["data"].empty();
+}
+
+// Copies a node and everything below it, name is empty inside sequences
+static void copyNode(cv::FileStorage &out, const cv::FileNode &node, const string &name)
+{
+    if (!name.empty())
+    {
+        out << name;
+    }
+
+    if (isMatrix(node))
+    {
+        cv::Mat mat;
+        node >> mat;
+        out << mat;
+    }
+    else if (node.isMap())
+    {
+        out << "{";
+        for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it)
+        {
+            copyNode(out, *it, (*it).name());
+        }
+        out << "}";
+    }
+    else if (node.isSeq())
+    {
+        out << "[";
+        for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it)
+        {
+            copyNode(out, *it, "");
+        }
+        out << "]";
+    }
+    else if (node.isInt())
+    {
+        out << (int)node;
+    }
+    else if (node.isReal())
+    {
+        out << (double)node;
+    }
+    else
+    {
+        out << (string)node;
+    }
+}
+
+bool LandmarkModel::convert(QString text_path, QString binary_path)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QString tmp_path = binary_path + ".tmp.yml";
+    try
+    {
+        cv::FileStorage in(text_path.toStdString(), cv::FileStorage::READ);
+        if (!in.isOpened())
+        {
+            qWarning() << "Can't open" << text_path;
+            return false;
+        }
+        cv::FileStorage out(tmp_path.toStdString(), cv::FileStorage::WRITE | cv::FileStorage::BASE64);
+        if (!out.isOpened())
+        {
+            qWarning() << "Can't write" << tmp_path;
+            return false;
+        }
+        cv::FileNode root = in.root();
+        for (cv::FileNodeIterator it = root.begin(); it != root.end(); ++it)
+        {
+            copyNode(out, *it, (*it).name());
+        }
+        out.release();
+
+        // a copy that does not load would be picked on every start, check it first
+        cv::Ptr<cv::face::Facemark> check = cv::face::createFacemarkLBF();
+        check->loadModel(tmp_path.toStdString());
+    }
+    catch (const cv::Exception &e)
+    {
+        qWarning() << "Can't convert the landmark model:" << e.what();
+        QFile::remove(tmp_path);
+        return false;
+    }
+
+    QFile::remove(binary_path);
+    if (!QFile::rename(tmp_path, binary_path))
+    {
+        qWarning() << "Can't move the converted landmark model to" << binary_path;
+        QFile::remove(tmp_path);
+        return false;
+    }
+    qDebug() << "converted" << text_path << "to" << binary_path << "in" << timer.elapsed() << "ms,"
+             << QFileInfo(text_path).size() / 1024 / 1024 << "MB ->" << QFileInfo(binary_path).size() / 1024 / 1024 << "MB";
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QString>
+
+/*
+ * lbfmodel.yaml stores every regression matrix as decimal text, and parsing
+ * it takes seconds. The model is converted once to a copy in which OpenCV's
+ * FileStorage writes the matrices as base64-encoded binary, which loads
+ * several times faster and with far fewer temporary strings. The converted
+ * copy is used whenever it is at least as new as the text model.
+ */
+class LandmarkModel
+{
+public:
+    static QString textPath();
+    static QString binaryPath();
+    static QString preferredPath(); // the binary copy if it is up to date, else the text model
+    static bool isConverted();
+
+    // writes the binary copy, checks that it loads and only then puts it in place
+    static bool convert(QString text_path, QString binary_path);
+};
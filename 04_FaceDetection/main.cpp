@@ -1,8 +1,31 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include "mainwindow.h"
+#include "face_benchmark.h"
 
 int main(int argc, char *argv[])
 {
+    // 04_FaceDetection --benchmark path/to/video compares the analysis scales offline
+    if (argc >= 3 && QString(argv[1]) == "--benchmark")
+    {
+        QCoreApplication app(argc, argv);
+        return FaceBenchmark::run(QString(argv[2]));
+    }
+
+    // 04_FaceDetection --benchmark-fit path/to/image_or_video measures landmark fitting against the face count
+    if (argc >= 3 && QString(argv[1]) == "--benchmark-fit")
+    {
+        QCoreApplication app(argc, argv);
+        return FaceBenchmark::runFitScaling(QString(argv[2]));
+    }
+
+    // 04_FaceDetection --benchmark-dataset path/to/images_or_video [options] scores detection and landmarks
+    if (argc >= 3 && QString(argv[1]) == "--benchmark-dataset")
+    {
+        QCoreApplication app(argc, argv);
+        return FaceBenchmark::runDataset(app.arguments().mid(2));
+    }
+
     QApplication app(argc, argv);
     MainWindow window;
     window.setWindowTitle("FaceDetection");
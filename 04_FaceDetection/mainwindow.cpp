@@ -9,16 +9,28 @@
 #include <QIcon>
 #include <QStandardItem>
 #include <QSize>
+#include <QInputDialog>
 
 #include "opencv2/videoio.hpp"
 
 #include "mainwindow.h"
 #include "utilities.h"
+#include "model_store.h"
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), fileMenu(nullptr), capturer(nullptr)
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), fileMenu(nullptr), detectionMenu(nullptr), capturer(nullptr)
 {
+    min_face_size = max_face_size = 0;
+    burst_count = 10;
+    burst_rate = 0.0;
+    continuous_rate = 2.0;
     initUI();
     data_lock = new QMutex();
+
+    // the face models load in the background while the window comes up
+    ModelStore *store = ModelStore::instance();
+    connect(store, &ModelStore::loadProgress, this, &MainWindow::modelLoadProgress);
+    connect(store, &ModelStore::loadFailed, this, &MainWindow::modelLoadFailed);
+    store->loadAll();
 }
 
 void MainWindow::initUI()
@@ -26,6 +38,7 @@ void MainWindow::initUI()
     this->resize(1000, 800);
     // setup menubar
     fileMenu = menuBar()->addMenu("&File");
+    detectionMenu = menuBar()->addMenu("&Detection");
 
     // main area
     QGridLayout *main_layout = new QGridLayout();
@@ -42,6 +55,17 @@ void MainWindow::initUI()
     tools_layout->addWidget(shutterButton, 0, 0, Qt::AlignHCenter);
     connect(shutterButton, SIGNAL(clicked(bool)), this, SLOT(takePhoto()));
 
+    burstButton = new QPushButton(this);
+    burstButton->setText("Burst");
+    tools_layout->addWidget(burstButton, 0, 1, Qt::AlignHCenter);
+    connect(burstButton, SIGNAL(clicked(bool)), this, SLOT(takeBurst()));
+
+    continuousButton = new QPushButton(this);
+    continuousButton->setText("Continuous");
+    continuousButton->setCheckable(true);
+    tools_layout->addWidget(continuousButton, 0, 2, Qt::AlignHCenter);
+    connect(continuousButton, SIGNAL(toggled(bool)), this, SLOT(toggleContinuousPhotos(bool)));
+
     // masks
     QGridLayout *masks_layout = new QGridLayout();
     main_layout->addLayout(masks_layout, 13, 0, 1, 1);
@@ -89,13 +113,64 @@ void MainWindow::createActions()
     fileMenu->addAction(cameraInfoAction);
     openCameraAction = new QAction("&Open Camera", this);
     fileMenu->addAction(openCameraAction);
+    openVideoAction = new QAction("Open &Video File...", this);
+    fileMenu->addAction(openVideoAction);
+    openStreamAction = new QAction("Open &Stream URL...", this);
+    fileMenu->addAction(openStreamAction);
+    fastReplayAction = new QAction("Fast &Replay of Video Files", this);
+    fastReplayAction->setCheckable(true);
+    fileMenu->addAction(fastReplayAction);
+    burstSettingsAction = new QAction("&Burst Settings...", this);
+    fileMenu->addAction(burstSettingsAction);
     exitAction = new QAction("E&xit", this);
     fileMenu->addAction(exitAction);
 
+    // full detection every N frames, faces are tracked with optical flow in between
+    const char *interval_names[4] = {"Detect &Every Frame", "Detect Every &5 Frames, Track Between",
+                                     "Detect Every &10 Frames, Track Between", "Detect Every &30 Frames, Track Between"};
+    QActionGroup *interval_group = new QActionGroup(this);
+    for (int i = 0; i < 4; i++)
+    {
+        intervalActions[i] = new QAction(interval_names[i], this);
+        intervalActions[i]->setCheckable(true);
+        interval_group->addAction(intervalActions[i]);
+        detectionMenu->addAction(intervalActions[i]);
+        connect(intervalActions[i], SIGNAL(triggered(bool)), this, SLOT(changeDetectInterval()));
+    }
+    intervalActions[0]->setChecked(true);
+
+    // the cascade runs on a downscaled copy of each frame, landmarks are fitted at full resolution
+    detectionMenu->addSeparator();
+    const char *scale_names[3] = {"&Full Resolution", "&1/2 Resolution", "1/&4 Resolution"};
+    QActionGroup *scale_group = new QActionGroup(this);
+    for (int i = 0; i < 3; i++)
+    {
+        scaleActions[i] = new QAction(scale_names[i], this);
+        scaleActions[i]->setCheckable(true);
+        scale_group->addAction(scaleActions[i]);
+        detectionMenu->addAction(scaleActions[i]);
+        connect(scaleActions[i], SIGNAL(triggered(bool)), this, SLOT(changeAnalysisScale()));
+    }
+    scaleActions[0]->setChecked(true);
+    faceSizeAction = new QAction("Face &Size Range...", this);
+    detectionMenu->addAction(faceSizeAction);
+    connect(faceSizeAction, SIGNAL(triggered(bool)), this, SLOT(changeFaceSizeRange()));
+
+    // temporal filtering of the landmarks, keeps the ornaments from jittering
+    detectionMenu->addSeparator();
+    smoothAction = new QAction("S&mooth Landmarks", this);
+    smoothAction->setCheckable(true);
+    smoothAction->setChecked(true);
+    detectionMenu->addAction(smoothAction);
+    connect(smoothAction, SIGNAL(triggered(bool)), this, SLOT(changeSmoothing()));
+
     // connect the signals and slots
     connect(exitAction, SIGNAL(triggered(bool)), QApplication::instance(), SLOT(quit()));
     connect(cameraInfoAction, SIGNAL(triggered(bool)), this, SLOT(showCameraInfo()));
     connect(openCameraAction, SIGNAL(triggered(bool)), this, SLOT(openCamera()));
+    connect(openVideoAction, SIGNAL(triggered(bool)), this, SLOT(openVideo()));
+    connect(openStreamAction, SIGNAL(triggered(bool)), this, SLOT(openStream()));
+    connect(burstSettingsAction, SIGNAL(triggered(bool)), this, SLOT(changeBurstSettings()));
 }
 
 void MainWindow::showCameraInfo()
@@ -113,26 +188,69 @@ void MainWindow::showCameraInfo()
 
 void MainWindow::openCamera()
 {
-    if (capturer != nullptr)
+    int camID = 0;
+    startCapture(new CaptureThread(camID, data_lock), QString("Capturing Camera %1").arg(camID));
+}
+
+void MainWindow::openVideo()
+{
+    QString path = QFileDialog::getOpenFileName(
+        this, "Open Video File", QDir::homePath(), "Videos (*.mp4 *.avi *.mov *.mkv *.m4v);;All files (*)");
+    if (path.isEmpty())
     {
-        // if a thread is already running, stop it
-        capturer->setRunning(false);
-        disconnect(capturer, &CaptureThread::frameCaptured, this, &MainWindow::updateFrame);
-        disconnect(capturer, &CaptureThread::photoTaken, this, &MainWindow::appendSavedPhoto);
-        connect(capturer, &CaptureThread::finished, capturer, &CaptureThread::deleteLater);
+        return;
+    }
+    startCapture(new CaptureThread(path, data_lock), QString("Playing %1").arg(QFileInfo(path).fileName()));
+}
+
+void MainWindow::openStream()
+{
+    bool ok = false;
+    QString url = QInputDialog::getText(
+        this, "Open Stream URL", "Stream URL (e.g. rtsp://host:554/stream):", QLineEdit::Normal, "", &ok);
+    if (!ok || url.trimmed().isEmpty())
+    {
+        return;
     }
+    startCapture(new CaptureThread(url.trimmed(), data_lock), QString("Streaming %1").arg(url.trimmed()));
+}
 
+void MainWindow::startCapture(CaptureThread *thread, QString status)
+{
+    // masks and a continuous series belong to the previous source, which may be deleted below
     for (int i = 0; i < CaptureThread::MASK_COUNT; i++)
     {
         mask_checkboxes[i]->setCheckState(Qt::Unchecked);
     }
+    continuousButton->setChecked(false);
 
-    int camID = 0;
-    capturer = new CaptureThread(camID, data_lock);
+    if (capturer != nullptr)
+    {
+        // if a thread is already running, stop it
+        capturer->setRunning(false);
+        disconnect(capturer, &CaptureThread::frameCaptured, this, &MainWindow::updateFrame);
+        disconnect(capturer, &CaptureThread::photoTaken, this, &MainWindow::appendSavedPhoto);
+        if (capturer->isFinished())
+        {
+            // e.g. a video file that has ended, finished() was emitted already
+            delete capturer;
+        }
+        else
+        {
+            connect(capturer, &CaptureThread::finished, capturer, &CaptureThread::deleteLater);
+        }
+    }
+
+    capturer = thread;
+    capturer->setReplayMode(fastReplayAction->isChecked() ? CaptureThread::FAST : CaptureThread::REALTIME);
+    changeDetectInterval();
+    changeAnalysisScale();
+    changeSmoothing();
+    capturer->setFaceSizeRange(min_face_size, max_face_size);
     connect(capturer, &CaptureThread::frameCaptured, this, &MainWindow::updateFrame);
     connect(capturer, &CaptureThread::photoTaken, this, &MainWindow::appendSavedPhoto);
     capturer->start();
-    mainStatusLabel->setText(QString("Capturing Camera %1").arg(camID));
+    mainStatusLabel->setText(status);
 }
 
 void MainWindow::updateFrame(cv::Mat *mat)
@@ -174,7 +292,7 @@ void MainWindow::populateSavedList()
 
     foreach (QFileInfo cover, files)
     {
-        QString name = cover.baseName();
+        QString name = cover.completeBaseName();
         QStandardItem *item = new QStandardItem();
         list_model->appendRow(item);
         QModelIndex index = list_model->indexFromItem(item);
@@ -183,15 +301,24 @@ void MainWindow::populateSavedList()
     }
 }
 
-void MainWindow::appendSavedPhoto(QString name)
+// The thumbnail was scaled by the photo encoder, the photo itself is not read again
+void MainWindow::appendSavedPhoto(QString name, QImage thumbnail)
 {
-    QString photo_path = Utilities::getPhotoPath(name, "jpg");
     QStandardItem *item = new QStandardItem();
     list_model->appendRow(item);
     QModelIndex index = list_model->indexFromItem(item);
-    list_model->setData(index, QPixmap(photo_path).scaledToHeight(145), Qt::DecorationRole);
+    list_model->setData(index, QPixmap::fromImage(thumbnail), Qt::DecorationRole);
     list_model->setData(index, name, Qt::DisplayRole);
     saved_list->scrollTo(index);
+
+    if (capturer != nullptr)
+    {
+        PhotoEncoder::Stats stats = capturer->photoStats();
+        mainStatusLabel->setText(
+            QString("Photos: %1 saved, %2 dropped, %3 pending, %4 ms to encode, %5 photos/s")
+                .arg(stats.saved).arg(stats.dropped).arg(stats.pending)
+                .arg(stats.encode_ms, 0, 'f', 1).arg(stats.photos_per_s, 0, 'f', 1));
+    }
 }
 
 void MainWindow::updateMasks(int status)
@@ -209,4 +336,142 @@ void MainWindow::updateMasks(int status)
             capturer->updateMasksFlag(static_cast<CaptureThread::MASK_TYPE>(i), status != 0);
         }
     }
+}
+
+void MainWindow::changeDetectInterval()
+{
+    const int intervals[4] = {1, 5, 10, 30};
+    if (capturer == nullptr)
+    {
+        return;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        if (intervalActions[i]->isChecked())
+        {
+            capturer->setDetectInterval(intervals[i]);
+        }
+    }
+}
+
+void MainWindow::changeAnalysisScale()
+{
+    const double scales[3] = {1.0, 0.5, 0.25};
+    if (capturer == nullptr)
+    {
+        return;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        if (scaleActions[i]->isChecked())
+        {
+            capturer->setAnalysisScale(scales[i]);
+        }
+    }
+}
+
+void MainWindow::changeSmoothing()
+{
+    if (capturer != nullptr)
+    {
+        capturer->setLandmarkSmoothing(smoothAction->isChecked());
+    }
+}
+
+void MainWindow::changeFaceSizeRange()
+{
+    bool ok = false;
+    int min_size = QInputDialog::getInt(
+        this, "Face Size Range", "Smallest face in pixels (0 for no limit):", min_face_size, 0, 4096, 10, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    int max_size = QInputDialog::getInt(
+        this, "Face Size Range", "Largest face in pixels (0 for no limit):", max_face_size, 0, 4096, 10, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    if (max_size > 0 && max_size < min_size)
+    {
+        std::swap(min_size, max_size);
+    }
+    min_face_size = min_size;
+    max_face_size = max_size;
+    if (capturer != nullptr)
+    {
+        capturer->setFaceSizeRange(min_face_size, max_face_size);
+    }
+}
+
+void MainWindow::modelLoadProgress(int loaded, int total, QString name)
+{
+    if (capturer != nullptr)
+    {
+        return;
+    }
+    if (loaded < total)
+    {
+        mainStatusLabel->setText(QString("Loading %1 (%2/%3)...").arg(name).arg(loaded + 1).arg(total));
+    }
+    else
+    {
+        mainStatusLabel->setText("Face Detection is Ready");
+    }
+}
+
+void MainWindow::modelLoadFailed(QString error)
+{
+    mainStatusLabel->setText("Face Detection is not available");
+    QMessageBox::warning(this, "Face Detection", error);
+}
+
+void MainWindow::takeBurst()
+{
+    if (capturer != nullptr)
+    {
+        capturer->startBurst(burst_count, burst_rate);
+    }
+}
+
+void MainWindow::toggleContinuousPhotos(bool on)
+{
+    if (capturer == nullptr)
+    {
+        return;
+    }
+    if (on)
+    {
+        capturer->startBurst(0, continuous_rate);
+    }
+    else
+    {
+        capturer->stopBurst();
+    }
+}
+
+void MainWindow::changeBurstSettings()
+{
+    bool ok = false;
+    int count = QInputDialog::getInt(this, "Burst Settings", "Photos per burst:", burst_count, 1, 1000, 1, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    double rate = QInputDialog::getDouble(
+        this, "Burst Settings", "Burst rate in photos per second (0 for every frame):", burst_rate, 0, 120, 1, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    double continuous = QInputDialog::getDouble(
+        this, "Burst Settings", "Continuous rate in photos per second (0 for every frame):", continuous_rate, 0, 120, 1, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    burst_count = count;
+    burst_rate = rate;
+    continuous_rate = continuous;
 }
\ No newline at end of file
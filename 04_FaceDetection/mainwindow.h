@@ -2,6 +2,7 @@
 
 #include <QMainWindow>
 #include <QMenuBar>
+#include <QActionGroup>
 #include <QAction>
 #include <QGraphicsScene>
 #include <QGraphicsView>
@@ -29,21 +30,42 @@ private:
     void initUI();
     void createActions();
     void populateSavedList();
+    void startCapture(CaptureThread *thread, QString status);
 
 private slots:
     void showCameraInfo();
     void openCamera();
+    void openVideo();
+    void openStream();
     void updateFrame(cv::Mat *);
     void takePhoto();
-    void appendSavedPhoto(QString name);
+    void appendSavedPhoto(QString name, QImage thumbnail);
+    void takeBurst();
+    void toggleContinuousPhotos(bool on);
+    void changeBurstSettings();
     void updateMasks(int status);
+    void changeDetectInterval();
+    void changeAnalysisScale();
+    void changeFaceSizeRange();
+    void changeSmoothing();
+    void modelLoadProgress(int loaded, int total, QString name);
+    void modelLoadFailed(QString error);
 
 private:
     QMenu *fileMenu;
+    QMenu *detectionMenu;
 
     QAction *cameraInfoAction;
     QAction *openCameraAction;
+    QAction *openVideoAction;
+    QAction *openStreamAction;
+    QAction *fastReplayAction;
+    QAction *burstSettingsAction;
     QAction *exitAction;
+    QAction *intervalActions[4];
+    QAction *scaleActions[3];
+    QAction *faceSizeAction;
+    QAction *smoothAction;
 
     QCheckBox *mask_checkboxes[CaptureThread::MASK_COUNT];
 
@@ -51,6 +73,13 @@ private:
     QGraphicsView *imageView;
 
     QPushButton *shutterButton;
+    QPushButton *burstButton;
+    QPushButton *continuousButton;
+
+    // burst photos, a rate of 0 takes every frame
+    int burst_count;
+    double burst_rate;
+    double continuous_rate;
 
     QListView *saved_list;
     QStandardItemModel *list_model;
@@ -60,6 +89,9 @@ private:
 
     cv::Mat currentFrame;
 
+    // face size range in full-resolution pixels, 0 leaves a bound open
+    int min_face_size, max_face_size;
+
     // for capture thread
     QMutex *data_lock;
     CaptureThread *capturer;
@@ -0,0 +1,162 @@
+#include <QFile>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "landmark_model.h"
+#include "model_store.h"
+
+ModelStore *ModelStore::instance()
+{
+    // never deleted, capture threads may still check contexts in while the application exits
+    static ModelStore *store = new ModelStore();
+    return store;
+}
+
+ModelStore::ModelStore() : state(NOT_STARTED), detector_count(0)
+{
+}
+
+void ModelStore::loadAll()
+{
+    QMutexLocker locker(&lock);
+    if (state != NOT_STARTED)
+    {
+        return;
+    }
+    state = LOADING;
+    QThreadPool::globalInstance()->start([this]()
+                                         { loadModels(); });
+}
+
+bool ModelStore::isLoaded()
+{
+    QMutexLocker locker(&lock);
+    return state == LOADED;
+}
+
+void ModelStore::loadModels()
+{
+    QString load_error;
+    QElapsedTimer timer;
+    timer.start();
+    FaceDetector *detector = newFaceDetector(load_error, true);
+
+    QMutexLocker locker(&lock);
+    if (detector == nullptr)
+    {
+        state = FAILED;
+        error = load_error;
+        changed.wakeAll();
+        locker.unlock();
+        qWarning() << error;
+        emit loadFailed(error);
+        return;
+    }
+    free_detectors << detector;
+    detector_count++;
+    state = LOADED;
+    changed.wakeAll();
+    locker.unlock();
+    qDebug() << "face models loaded from" << LandmarkModel::preferredPath() << "in" << timer.elapsed() << "ms";
+
+    // one-time conversion after the text model was loaded, the next start reads the binary copy
+    if (!LandmarkModel::isConverted())
+    {
+        LandmarkModel::convert(LandmarkModel::textPath(), LandmarkModel::binaryPath());
+    }
+}
+
+FaceDetector *ModelStore::newFaceDetector(QString &error, bool report_progress)
+{
+    QString model_path = LandmarkModel::preferredPath();
+    if (!QFile::exists(model_path))
+    {
+        error = "Model file not found: " + model_path + ". Please run the command `curl -O https://raw.githubusercontent.com/kurnianggoro/GSOC2017/master/data/lbfmodel.yaml` and move the downloaded file to the `models` folder.";
+        return nullptr;
+    }
+
+    FaceDetector *detector = new FaceDetector();
+    if (report_progress)
+    {
+        emit loadProgress(0, 2, "face cascade");
+    }
+    if (!detector->loadCascade(OPENCV_DATA_DIR "haarcascades/haarcascade_frontalface_default.xml"))
+    {
+        error = "Can't load the Haar cascade from " OPENCV_DATA_DIR;
+        delete detector;
+        return nullptr;
+    }
+    if (report_progress)
+    {
+        emit loadProgress(1, 2, "landmark model");
+    }
+    try
+    {
+        // only the first context loads the shared instances, a few are enough to keep the cores busy
+        if (marks.size() == 0)
+        {
+            marks.load(model_path.toStdString(), min(cv::getNumThreads(), 4));
+        }
+        detector->setFacemarkPool(&marks);
+    }
+    catch (const cv::Exception &e)
+    {
+        error = "Can't load the landmark model " + model_path + ": " + QString::fromStdString(e.what());
+        delete detector;
+        return nullptr;
+    }
+    if (report_progress)
+    {
+        emit loadProgress(2, 2, "");
+    }
+    return detector;
+}
+
+FaceDetector *ModelStore::checkoutFaceDetector()
+{
+    loadAll();
+    QMutexLocker locker(&lock);
+    while (state == LOADING)
+    {
+        changed.wait(&lock);
+    }
+    if (state == FAILED)
+    {
+        return nullptr;
+    }
+
+    if (!free_detectors.isEmpty())
+    {
+        return free_detectors.takeLast();
+    }
+
+    // several pipelines at once. Another context only parses the cascade, it borrows
+    // the Facemark instances of the store, so it is loaded right away outside of the lock
+    locker.unlock();
+    QString load_error;
+    FaceDetector *detector = newFaceDetector(load_error, false);
+    if (detector == nullptr)
+    {
+        qWarning() << load_error;
+        return nullptr;
+    }
+    locker.relock();
+    detector_count++;
+    qDebug() << "loaded face detection context" << detector_count;
+    return detector;
+}
+
+void ModelStore::checkin(FaceDetector *detector)
+{
+    if (detector == nullptr)
+    {
+        return;
+    }
+    // the next stream starts with a full detection
+    detector->reset();
+    detector->resetCounts();
+
+    QMutexLocker locker(&lock);
+    free_detectors << detector;
+}
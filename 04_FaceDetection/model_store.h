@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "facemark_pool.h"
+#include "face_detector.h"
+
+/*
+ * Process-wide store of the face models. The Haar cascade and the LBF model
+ * (tens of MB of YAML) are loaded once, in the background right after start,
+ * instead of every time a camera or video is opened. Progress and failures are
+ * reported through signals.
+ *
+ * A loaded FaceDetector is an inference context: it holds per-stream state, so
+ * a capture thread checks one out for as long as it runs and checks it back in
+ * when it stops. Reopening the camera gets the same context back. If several
+ * threads need one at the same time another context is loaded on demand. The
+ * LBF model is not part of a context: every context borrows Facemark
+ * instances from the one pool of the store, so the model is only held as often
+ * as fits run at once.
+ */
+class ModelStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ModelStore *instance();
+
+    void loadAll(); // starts loading in the background, only the first call does anything
+    bool isLoaded();
+
+    // Blocks until the models are loaded, nullptr if they could not be loaded
+    FaceDetector *checkoutFaceDetector();
+    FacemarkPool *facemarkPool() { return &marks; };
+    void checkin(FaceDetector *detector);
+
+signals:
+    void loadProgress(int loaded, int total, QString name);
+    void loadFailed(QString error);
+
+private:
+    ModelStore();
+    void loadModels(); // on the loader thread
+    FaceDetector *newFaceDetector(QString &error, bool report_progress);
+
+private:
+    enum State
+    {
+        NOT_STARTED,
+        LOADING,
+        LOADED,
+        FAILED,
+    };
+
+    QMutex lock;
+    QWaitCondition changed; // state changed
+    State state;
+    QString error;
+    QList<FaceDetector *> free_detectors;
+    int detector_count;
+    FacemarkPool marks; // loaded once by the loader thread, before the state is LOADED
+};
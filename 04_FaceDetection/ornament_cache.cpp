@@ -0,0 +1,95 @@
+#include "ornament_cache.h"
+
+static const int WIDTH_STEP = 4;    // pixels
+static const int ANGLE_STEP = 2;    // degrees
+static const size_t MAX_VARIANTS = 64;
+
+OrnamentCache::OrnamentCache() : draw_count(0)
+{
+}
+
+void OrnamentCache::setOrnament(const cv::Mat &bgr)
+{
+    cv::Mat gray;
+    cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+    alpha = 255 - gray;
+
+    cv::Mat alpha3;
+    cv::cvtColor(alpha, alpha3, cv::COLOR_GRAY2BGR);
+    cv::multiply(bgr, alpha3, premultiplied, 1.0 / 255);
+    variants.clear();
+}
+
+const OrnamentCache::Variant &OrnamentCache::variant(double width, double angle)
+{
+    int width_q = max(1, cvRound(width / WIDTH_STEP));
+    int angle_q = cvRound(angle / ANGLE_STEP);
+    pair<int, int> key(width_q, angle_q);
+
+    map<pair<int, int>, Variant>::iterator found = variants.find(key);
+    if (found != variants.end())
+    {
+        found->second.last_used = draw_count;
+        return found->second;
+    }
+
+    if (variants.size() >= MAX_VARIANTS)
+    {
+        map<pair<int, int>, Variant>::iterator oldest = variants.begin();
+        for (map<pair<int, int>, Variant>::iterator it = variants.begin(); it != variants.end(); ++it)
+        {
+            if (it->second.last_used < oldest->second.last_used)
+            {
+                oldest = it;
+            }
+        }
+        variants.erase(oldest);
+    }
+
+    // resize
+    double scale = (double)width_q * WIDTH_STEP / premultiplied.cols;
+    cv::Mat scaled_color, scaled_alpha;
+    cv::resize(premultiplied, scaled_color, cv::Size(0, 0), scale, scale, cv::INTER_AREA);
+    cv::resize(alpha, scaled_alpha, cv::Size(0, 0), scale, scale, cv::INTER_AREA);
+
+    // rotate onto a canvas large enough for the corners, the padding is transparent
+    cv::Point2f center(scaled_color.cols / 2.0f, scaled_color.rows / 2.0f);
+    cv::Mat rotate_matrix = cv::getRotationMatrix2D(center, angle_q * ANGLE_STEP, 1.0);
+    cv::Rect2f bounds = cv::RotatedRect(center, scaled_color.size(), angle_q * ANGLE_STEP).boundingRect2f();
+    rotate_matrix.at<double>(0, 2) += bounds.width / 2.0 - center.x;
+    rotate_matrix.at<double>(1, 2) += bounds.height / 2.0 - center.y;
+    cv::Size size(cvCeil(bounds.width), cvCeil(bounds.height));
+
+    Variant &v = variants[key];
+    cv::Mat rotated_alpha;
+    cv::warpAffine(scaled_color, v.premultiplied, rotate_matrix, size, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    cv::warpAffine(scaled_alpha, rotated_alpha, rotate_matrix, size, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    cv::cvtColor(255 - rotated_alpha, v.inverse_alpha, cv::COLOR_GRAY2BGR);
+    v.last_used = draw_count;
+    return v;
+}
+
+void OrnamentCache::draw(cv::Mat &frame, cv::Point2f center, double width, double angle)
+{
+    if (isEmpty() || width < 1.0)
+    {
+        return;
+    }
+    draw_count++;
+    const Variant &v = variant(width, angle);
+
+    // clip the ornament to the frame
+    cv::Rect placed(cvRound(center.x - v.premultiplied.cols / 2.0), cvRound(center.y - v.premultiplied.rows / 2.0),
+                    v.premultiplied.cols, v.premultiplied.rows);
+    cv::Rect visible = placed & cv::Rect(0, 0, frame.cols, frame.rows);
+    if (visible.empty())
+    {
+        return;
+    }
+    cv::Rect source = visible - placed.tl();
+
+    // frame = frame * (1 - alpha) + color * alpha
+    cv::Mat roi = frame(visible);
+    cv::multiply(roi, v.inverse_alpha(source), roi, 1.0 / 255);
+    cv::add(roi, v.premultiplied(source), roi);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <map>
+#include <utility>
+#include "opencv2/opencv.hpp"
+
+using namespace std;
+
+/*
+ * Pre-rendered variants of one ornament. The ornament images are black
+ * drawings on white, white is treated as transparent: the darkness of a pixel
+ * is its alpha and the color is premultiplied by it, so rotation can pad with
+ * zeros and compositing needs no division.
+ *
+ * Variants are rendered once per quantized width (4 px steps) and angle
+ * (2 degree steps) and then reused as long as the face holds still; the least
+ * recently used variants are dropped beyond a fixed count. Compositing writes
+ * straight into the frame with vectorized cv::multiply/cv::add, an ornament
+ * hanging over the frame edge is clipped instead of skipped.
+ */
+class OrnamentCache
+{
+public:
+    OrnamentCache();
+
+    void setOrnament(const cv::Mat &bgr);
+    bool isEmpty() const { return premultiplied.empty(); };
+    // width in pixels, angle in degrees as used by cv::getRotationMatrix2D
+    void draw(cv::Mat &frame, cv::Point2f center, double width, double angle);
+
+private:
+    struct Variant
+    {
+        cv::Mat premultiplied;  // color * alpha, CV_8UC3
+        cv::Mat inverse_alpha;  // 255 - alpha on all three channels, CV_8UC3
+        unsigned long last_used;
+    };
+
+    const Variant &variant(double width, double angle);
+
+private:
+    cv::Mat premultiplied; // full-size source
+    cv::Mat alpha;
+    map<pair<int, int>, Variant> variants;
+    unsigned long draw_count;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QMutex>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+#include "opencv2/opencv.hpp"
+
+/*
+ * Encodes and writes photos on a small thread pool so that the capture loop
+ * only pays for copying the frame. At most max_pending frames wait for
+ * encoding at any time, a frame submitted beyond that is dropped and counted,
+ * which bounds the memory a long burst can take. photoSaved() is emitted from
+ * a pool thread once the file is on disk, together with a thumbnail scaled on
+ * the pool, so the GUI never decodes the full-size JPEG.
+ */
+class PhotoEncoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        int saved;
+        int dropped;
+        int pending;
+        double encode_ms;    // average per photo
+        double photos_per_s; // saved since the first submit of the current burst
+    };
+
+    explicit PhotoEncoder(int max_pending = 8, QObject *parent = nullptr);
+    ~PhotoEncoder();
+
+    // copies the frame, false if it was dropped because too many are pending
+    bool submit(const cv::Mat &frame, QString name);
+    void startBurst(); // restarts the throughput clock and the counters
+    Stats stats();
+    void waitForDone() { pool.waitForDone(); };
+
+signals:
+    void photoSaved(QString name, QImage thumbnail);
+
+private:
+    void encode(cv::Mat frame, QString name); // on the pool
+
+private:
+    QThreadPool pool;
+    int max_pending;
+
+    QMutex lock;
+    int saved, dropped, pending;
+    double total_encode_ms;
+    QElapsedTimer burst_clock;
+};
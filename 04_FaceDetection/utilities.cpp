@@ -3,6 +3,7 @@
 #include <QDateTime>
 #include <QDir>
 #include <QStandardPaths>
+#include <QMutex>
 #include <QDebug>
 
 #include "utilities.h"
@@ -26,12 +27,23 @@ QString Utilities::getDataPath()
 
 QString Utilities::newPhotoName()
 {
-    // Get the current date and time
+    // Get the current date and time, down to the millisecond
     QDateTime time = QDateTime::currentDateTime();
-    
-    // Return the current date and time as a string formatted in the given pattern.
-    // This will be used as the new name for the photo.
-    return time.toString("yyyy-MM-dd+HH:mm:ss");
+    QString name = time.toString("yyyy-MM-dd+HH:mm:ss.zzz");
+
+    // Photos of a burst can be taken within the same millisecond, they get a sequence number.
+    // The lock makes the names unique even if several threads take photos.
+    static QMutex lock;
+    static QString last_name;
+    static int sequence = 0;
+    QMutexLocker locker(&lock);
+    if (name == last_name)
+    {
+        return QString("%1-%2").arg(name).arg(++sequence);
+    }
+    last_name = name;
+    sequence = 0;
+    return name;
 }
 
 QString Utilities::getPhotoPath(QString name, QString postfix)
@@ -41,3 +53,9 @@ QString Utilities::getPhotoPath(QString name, QString postfix)
     // For example, it might return something like: "/Users/user/Pictures/Facetious/2023-08-09+22:15:23.jpg"
     return QString("%1/%2.%3").arg(Utilities::getDataPath(), name, postfix);
 }
+
+QString Utilities::getLandmarkModelPath()
+{
+    // The LBF model is not bundled, it is expected in the models folder at the root of the repository
+    return QCoreApplication::applicationDirPath() + "/../../../models/lbfmodel.yaml";
+}
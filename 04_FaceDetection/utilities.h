@@ -8,4 +8,5 @@ class Utilities
     static QString getDataPath();
     static QString newPhotoName();
     static QString getPhotoPath(QString name, QString postfix);
+    static QString getLandmarkModelPath();
 };
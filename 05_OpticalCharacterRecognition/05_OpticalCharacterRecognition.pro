@@ -30,5 +30,5 @@ unix: mac {
 DEFINES += TESSDATA_PREFIX=\\\"/opt/homebrew/share/tessdata/\\\"
 
 # Input
-HEADERS += mainwindow.h screencapturer.h
-SOURCES += main.cpp mainwindow.cpp screencapturer.cpp
+HEADERS += mainwindow.h screencapturer.h model_store.h
+SOURCES += main.cpp mainwindow.cpp screencapturer.cpp model_store.cpp
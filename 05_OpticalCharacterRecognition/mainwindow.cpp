@@ -7,10 +7,17 @@
 
 #include "mainwindow.h"
 #include "screencapturer.h"
+#include "model_store.h"
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), currentImage(nullptr), tesseractAPI(nullptr)
 {
     initUI();
+
+    // the EAST model loads in the background while the window comes up
+    ModelStore *store = ModelStore::instance();
+    connect(store, &ModelStore::loadProgress, this, &MainWindow::modelLoadProgress);
+    connect(store, &ModelStore::loadFailed, this, &MainWindow::modelLoadFailed);
+    store->loadAll();
 }
 
 MainWindow::~MainWindow()
@@ -279,12 +286,21 @@ cv::Mat MainWindow::detectTextAreas(QImage &image, std::vector<cv::Rect> &areas)
     float nmsThreshold = 0.4;
     int inputWidth = 320;
     int inputHeight = 320;
-    std::string model = QApplication::instance()->applicationDirPath().toStdString() + "/../../../models/frozen_east_text_detection.pb";
 
-    // Load DNN network if it's not already loaded
+    // Convert QImage to cv::Mat
+    cv::Mat frame = cv::Mat(
+                        image.height(),
+                        image.width(),
+                        CV_8UC3,
+                        image.bits(),
+                        image.bytesPerLine())
+                        .clone();
+
+    // The network is loaded once by the model store, this only waits if it is still loading
+    cv::dnn::Net net = ModelStore::instance()->checkoutTextDetector();
     if (net.empty())
     {
-        net = cv::dnn::readNet(model);
+        return frame;
     }
 
     std::vector<cv::Mat> outs;
@@ -293,14 +309,6 @@ cv::Mat MainWindow::detectTextAreas(QImage &image, std::vector<cv::Rect> &areas)
     layerNames[0] = "feature_fusion/Conv_7/Sigmoid";
     layerNames[1] = "feature_fusion/concat_3";
 
-    // Convert QImage to cv::Mat
-    cv::Mat frame = cv::Mat(
-                        image.height(),
-                        image.width(),
-                        CV_8UC3,
-                        image.bits(),
-                        image.bytesPerLine())
-                        .clone();
     cv::Mat blob; // blob = binary large object
 
     // Preprocess the image to be fed into the neural network
@@ -321,6 +329,8 @@ cv::Mat MainWindow::detectTextAreas(QImage &image, std::vector<cv::Rect> &areas)
     std::vector<float> confidences;
     // Decode the scores and geometries to bounding boxes and confidence scores
     decode(scores, geometry, confThreshold, boxes, confidences);
+    // the outputs share memory with the network, it is handed back only once they are decoded
+    ModelStore::instance()->checkin(net);
 
     std::vector<int> indices;
     // Perform non-maximum suppression to remove overlapping boxes
@@ -420,3 +430,21 @@ void MainWindow::startCapture()
     cap->show();
     cap->activateWindow();
 }
+
+void MainWindow::modelLoadProgress(int loaded, int total, QString name)
+{
+    if (loaded < total)
+    {
+        mainStatusLabel->setText(QString("Loading %1 (%2/%3)...").arg(name).arg(loaded + 1).arg(total));
+    }
+    else
+    {
+        mainStatusLabel->setText("Text detection is ready");
+    }
+}
+
+void MainWindow::modelLoadFailed(QString error)
+{
+    mainStatusLabel->setText("Text detection is not available");
+    QMessageBox::information(this, "Error", error);
+}
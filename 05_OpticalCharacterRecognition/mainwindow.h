@@ -45,6 +45,8 @@ private slots:
     void extractText();
     void captureScreen();
     void startCapture();
+    void modelLoadProgress(int loaded, int total, QString name);
+    void modelLoadFailed(QString error);
 
 private:
     QMenu *fileMenu;
@@ -71,5 +73,4 @@ private:
     QGraphicsPixmapItem *currentImage;
 
     tesseract::TessBaseAPI *tesseractAPI;
-    cv::dnn::Net net;
 };
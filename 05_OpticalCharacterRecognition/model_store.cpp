@@ -0,0 +1,115 @@
+#include <QApplication>
+#include <QFile>
+#include <QThreadPool>
+#include <QDebug>
+
+#include "model_store.h"
+
+ModelStore *ModelStore::instance()
+{
+    // never deleted, nets may still be checked in while the application exits
+    static ModelStore *store = new ModelStore();
+    return store;
+}
+
+ModelStore::ModelStore() : state(NOT_STARTED)
+{
+}
+
+void ModelStore::loadAll()
+{
+    QMutexLocker locker(&lock);
+    if (state != NOT_STARTED)
+    {
+        return;
+    }
+    state = LOADING;
+    QThreadPool::globalInstance()->start([this]()
+                                         { loadModels(); });
+}
+
+bool ModelStore::isLoaded()
+{
+    QMutexLocker locker(&lock);
+    return state == LOADED;
+}
+
+void ModelStore::loadModels()
+{
+    QString path = QCoreApplication::applicationDirPath() + "/../../../models/frozen_east_text_detection.pb";
+    QString load_error;
+    std::vector<uchar> graph;
+    cv::dnn::Net net;
+
+    emit loadProgress(0, 2, "EAST model");
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        load_error = "Can't read the EAST model " + path + ": " + file.errorString();
+    }
+    else
+    {
+        QByteArray data = file.readAll();
+        graph.assign(data.constBegin(), data.constEnd());
+
+        emit loadProgress(1, 2, "EAST network");
+        try
+        {
+            net = cv::dnn::readNetFromTensorflow(graph);
+        }
+        catch (const cv::Exception &e)
+        {
+            load_error = "Can't load the EAST model " + path + ": " + QString::fromStdString(e.what());
+        }
+    }
+
+    QMutexLocker locker(&lock);
+    if (net.empty())
+    {
+        state = FAILED;
+        error = load_error;
+        changed.wakeAll();
+        locker.unlock();
+        qWarning() << error;
+        emit loadFailed(error);
+        return;
+    }
+    east_graph.swap(graph);
+    free_nets << net;
+    state = LOADED;
+    changed.wakeAll();
+    locker.unlock();
+    emit loadProgress(2, 2, "");
+}
+
+cv::dnn::Net ModelStore::checkoutTextDetector()
+{
+    loadAll();
+    QMutexLocker locker(&lock);
+    while (state == LOADING)
+    {
+        changed.wait(&lock);
+    }
+    if (state == FAILED)
+    {
+        return cv::dnn::Net();
+    }
+    if (!free_nets.isEmpty())
+    {
+        return free_nets.takeLast();
+    }
+    // the graph in memory is immutable, it is read without the lock
+    locker.unlock();
+    qDebug() << "building another EAST network";
+    return cv::dnn::readNetFromTensorflow(east_graph);
+}
+
+void ModelStore::checkin(const cv::dnn::Net &net)
+{
+    if (net.empty())
+    {
+        return;
+    }
+    QMutexLocker locker(&lock);
+    free_nets << net;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <vector>
+#include "opencv2/dnn.hpp"
+
+/*
+ * Process-wide store of the EAST text detection model. The frozen graph is
+ * read once, in the background right after start, instead of on the first
+ * detection. Progress and failures are reported through signals.
+ *
+ * A cv::dnn::Net keeps its intermediate blobs between forward passes and must
+ * not run on two threads at once, so each caller checks a net out and checks
+ * it back in after the pass. Additional nets are built from the graph kept in
+ * memory, the file is never parsed from disk again.
+ */
+class ModelStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ModelStore *instance();
+
+    void loadAll(); // starts loading in the background, only the first call does anything
+    bool isLoaded();
+
+    // Blocks until the model is loaded, an empty net if it could not be loaded
+    cv::dnn::Net checkoutTextDetector();
+    void checkin(const cv::dnn::Net &net);
+
+signals:
+    void loadProgress(int loaded, int total, QString name);
+    void loadFailed(QString error);
+
+private:
+    ModelStore();
+    void loadModels(); // on the loader thread
+
+private:
+    enum State
+    {
+        NOT_STARTED,
+        LOADING,
+        LOADED,
+        FAILED,
+    };
+
+    QMutex lock;
+    QWaitCondition changed;
+    State state;
+    QString error;
+    std::vector<uchar> east_graph;
+    QList<cv::dnn::Net> free_nets;
+};
@@ -26,5 +26,5 @@ DEFINES += OPENCV_DATA_DIR=\\\"/opt/homebrew/share/opencv4/\\\"
 DEFINES += TIME_MEASURE=1
 
 # Input
-HEADERS += capture_thread.h mainwindow.h utilities.h
-SOURCES += capture_thread.cpp main.cpp mainwindow.cpp utilities.cpp
+HEADERS += capture_thread.h mainwindow.h utilities.h model_store.h photo_encoder.h dnn_worker.h batch_scheduler.h yolo_decoder.h
+SOURCES += capture_thread.cpp main.cpp mainwindow.cpp utilities.cpp model_store.cpp photo_encoder.cpp dnn_worker.cpp batch_scheduler.cpp yolo_decoder.cpp
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QDeadlineTimer>
+#include <QQueue>
+#include <QMap>
+#include <QString>
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "opencv2/dnn.hpp"
+
+using namespace std;
+
+/*
+ * Collects frames from any number of capture threads into one N x 3 x 416 x
+ * 416 blob and runs a single YOLOv3 forward pass for all of them. A batch is
+ * started as soon as it is full, as soon as every client has submitted all the
+ * frames it may have in flight, or once the oldest frame has waited
+ * max_wait_ms. A single live camera is therefore never delayed, several
+ * streams share one pass, and a fast replay that keeps several consecutive
+ * frames in flight fills batches on its own.
+ *
+ * The outputs of the pass are split per frame and handed back by ticket. The
+ * scheduler owns its net, so the threads that use it need no net of their own.
+ */
+class BatchScheduler : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit BatchScheduler(cv::dnn::Net net, int max_batch = 4, int max_wait_ms = 20);
+    ~BatchScheduler();
+
+    // A client keeps at most depth frames in flight, so the scheduler knows when no more can come
+    void addClient(int depth);
+    void removeClient(int depth);
+    int maxBatch() const { return max_batch; };
+
+    // The frame must stay unchanged until its result was taken with wait()
+    qint64 submit(const cv::Mat &frame);
+    // Blocks until the outputs of the ticket's frame are ready, false if the scheduler stopped
+    bool wait(qint64 ticket, vector<cv::Mat> &outs);
+    void stop();
+
+    struct Stats
+    {
+        int batches;
+        int frames;
+        double batch_size; // average
+        double frame_ms;   // forward time per frame
+    };
+    Stats stats();
+
+    // Compares a batch of 2 with two single passes over an image, 0 if they agree
+    static int checkBatching(QString image_path);
+
+protected:
+    void run() override;
+
+private:
+    struct Request
+    {
+        qint64 ticket;
+        cv::Mat frame;
+        QDeadlineTimer due; // max_wait_ms after the frame was submitted
+    };
+
+    cv::dnn::Net net;
+    int max_batch;
+    int max_wait_ms;
+
+    QMutex lock;
+    QWaitCondition request_added;
+    QWaitCondition result_ready;
+    QQueue<Request> requests;
+    QMap<qint64, vector<cv::Mat>> results;
+    qint64 next_ticket;
+    int client_depth; // frames all clients together may have in flight
+    bool quit;
+
+    // metrics, guarded by lock
+    int batches;
+    int frames;
+    double total_forward_ms;
+};
@@ -1,29 +1,68 @@
 #include <QTime>
+#include <QElapsedTimer>
 #include <QDebug>
 #include <QApplication>
 
 #include <fstream>
 
 #include "utilities.h"
+#include "model_store.h"
 #include "capture_thread.h"
 
 CaptureThread::CaptureThread(int camera, QMutex *lock) : running(false), cameraID(camera), videoPath(""), data_lock(lock)
 {
     frame_width = frame_height = 0;
+    replay_mode = REALTIME;
     taking_photo = false;
+    encoder = new PhotoEncoder(8, this);
+    connect(encoder, &PhotoEncoder::photoSaved, this, &CaptureThread::photoTaken);
+    burst_count = burst_interval_ms = 0;
+    burst_requested = burst_stop_requested = false;
+    burst_left = 0;
+    next_shot_ms = 0;
+    inference_mode = SYNCHRONOUS;
+    dnn_worker = nullptr;
+    lag_frames = 0;
+    batch_scheduler = nullptr;
+    batch_depth = 1;
 }
 
 CaptureThread::CaptureThread(QString videoPath, QMutex *lock) : running(false), cameraID(-1), videoPath(videoPath), data_lock(lock)
 {
     frame_width = frame_height = 0;
+    replay_mode = REALTIME;
     taking_photo = false;
+    encoder = new PhotoEncoder(8, this);
+    connect(encoder, &PhotoEncoder::photoSaved, this, &CaptureThread::photoTaken);
+    burst_count = burst_interval_ms = 0;
+    burst_requested = burst_stop_requested = false;
+    burst_left = 0;
+    next_shot_ms = 0;
+    inference_mode = SYNCHRONOUS;
+    dnn_worker = nullptr;
+    lag_frames = 0;
+    batch_scheduler = nullptr;
+    batch_depth = 1;
 }
 
 void CaptureThread::run()
 {
     running = true;
-    cv::VideoCapture cap(cameraID);
-    // cv::VideoCapture cap("/home/kdr2/Videos/WIN_20190123_20_14_56_Pro.mp4");
+    cv::VideoCapture cap;
+    if (videoPath.isEmpty())
+    {
+        cap.open(cameraID);
+    }
+    else
+    {
+        cap.open(videoPath.toStdString());
+    }
+    if (!cap.isOpened())
+    {
+        qWarning() << "Error opening video source" << (videoPath.isEmpty() ? QString::number(cameraID) : videoPath);
+        running = false;
+        return;
+    }
     cv::Mat tmp_frame;
 
     frame_width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
@@ -32,6 +71,48 @@ void CaptureThread::run()
     // Cat face detection
     classifier = new cv::CascadeClassifier(OPENCV_DATA_DIR "haarcascades/haarcascade_frontalcatface_extended.xml");
 
+    // YOLOv3 is loaded once per process by the model store, this only waits while it is still loading.
+    // Batched streams share the net of the scheduler instead of checking out one of their own
+    if (inference_mode == BATCHED)
+    {
+        batch_scheduler = ModelStore::instance()->batchScheduler();
+    }
+    else
+    {
+        net = ModelStore::instance()->checkoutYolo();
+    }
+    objectClasses = ModelStore::instance()->classNames();
+    if (net.empty() && batch_scheduler == nullptr)
+    {
+        qWarning() << "Object detection is not available";
+    }
+    else if (batch_scheduler != nullptr)
+    {
+        // latency doesn't matter in a fast replay, consecutive frames fill the batches
+        batch_depth = isFileSource() && replay_mode == FAST ? batch_scheduler->maxBatch() : 1;
+        batch_scheduler->addClient(batch_depth);
+    }
+    else if (inference_mode == ASYNCHRONOUS)
+    {
+        // the worker uses the net until it is stopped, the capture thread no longer touches it
+        dnn_worker = new DnnWorker(net);
+        dnn_worker->start();
+    }
+    detections = Detections();
+    lag_frames = 0;
+
+    // Video files are paced to their own frame rate unless replayed as fast as possible,
+    // cameras and network streams deliver frames at their own pace
+    bool paced = isFileSource() && replay_mode == REALTIME;
+    double source_fps = cap.get(cv::CAP_PROP_FPS);
+    if (source_fps <= 0)
+    {
+        source_fps = 30;
+    }
+    QElapsedTimer replay_clock;
+    replay_clock.start();
+    int frame_count = 0;
+
     while (running)
     {
         cap >> tmp_frame;
@@ -39,8 +120,17 @@ void CaptureThread::run()
         {
             break;
         }
+        frame_count++;
+        if (paced)
+        {
+            qint64 ahead_ms = (qint64)(frame_count * 1000.0 / source_fps) - replay_clock.elapsed();
+            if (ahead_ms > 0)
+            {
+                msleep(ahead_ms);
+            }
+        }
 
-        if (taking_photo)
+        if (taking_photo || burstShotDue())
         {
             takePhoto(tmp_frame);
         }
@@ -49,7 +139,27 @@ void CaptureThread::run()
         int64 t0 = cv::getTickCount();
 #endif
         // detectObjects(tmp_frame);
-        detectObjectsDNN(tmp_frame);
+        if (batch_scheduler != nullptr)
+        {
+            // a frame is shown once its result is back, batch_depth - 1 frames later
+            batch_frames.enqueue(qMakePair(tmp_frame, batch_scheduler->submit(tmp_frame)));
+            tmp_frame = cv::Mat();
+            if (batch_frames.size() < batch_depth)
+            {
+                continue;
+            }
+            QPair<cv::Mat, qint64> next = batch_frames.dequeue();
+            tmp_frame = next.first;
+            detectObjectsBatched(tmp_frame, next.second);
+        }
+        else if (dnn_worker != nullptr)
+        {
+            detectObjectsAsync(tmp_frame, frame_count);
+        }
+        else
+        {
+            detectObjectsDNN(tmp_frame);
+        }
 
 #ifdef TIME_MEASURE
         int64 t1 = cv::getTickCount();
@@ -65,7 +175,41 @@ void CaptureThread::run()
         data_lock->unlock();
         emit frameCaptured(&frame);
     }
+    if (!videoPath.isEmpty())
+    {
+        double elapsed_s = replay_clock.elapsed() / 1000.0;
+        qDebug() << "replayed" << frame_count << "frames of" << videoPath << "in" << elapsed_s << "s,"
+                 << (elapsed_s > 0 ? frame_count / elapsed_s : 0.0) << "fps";
+    }
+    if (dnn_worker != nullptr)
+    {
+        DnnWorker::Stats stats = dnn_worker->stats();
+        qDebug() << stats.completed << "asynchronous forward passes of" << stats.forward_ms << "ms," << stats.replaced
+                 << "frames replaced while waiting, results lagged"
+                 << (stats.completed > 0 ? (double)lag_frames / stats.completed : 0.0) << "frames on average";
+        dnn_worker->stop();
+        dnn_worker->wait();
+        delete dnn_worker;
+        dnn_worker = nullptr;
+    }
+    if (batch_scheduler != nullptr)
+    {
+        // the frames still in flight are not shown, but their results must be collected
+        vector<cv::Mat> outs;
+        while (!batch_frames.isEmpty())
+        {
+            batch_scheduler->wait(batch_frames.dequeue().second, outs);
+        }
+        batch_scheduler->removeClient(batch_depth);
+        BatchScheduler::Stats stats = batch_scheduler->stats();
+        qDebug() << "batched inference:" << stats.frames << "frames in" << stats.batches << "forward passes of"
+                 << stats.batch_size << "frames on average," << stats.frame_ms << "ms per frame";
+        batch_scheduler = nullptr;
+    }
+
     cap.release();
+    ModelStore::instance()->checkin(net);
+    net = cv::dnn::Net();
     delete classifier;
     classifier = nullptr;
     running = false;
@@ -73,13 +217,49 @@ void CaptureThread::run()
 
 void CaptureThread::takePhoto(cv::Mat &frame)
 {
-    QString photo_name = Utilities::newPhotoName();
-    QString photo_path = Utilities::getPhotoPath(photo_name, "jpg");
-    cv::imwrite(photo_path.toStdString(), frame);
-    emit photoTaken(photo_name);
+    // encoding and writing happen on the encoder pool, the loop only pays for the copy
+    encoder->submit(frame, Utilities::newPhotoName());
     taking_photo = false;
 }
 
+void CaptureThread::startBurst(int count, double rate)
+{
+    burst_count = count;
+    burst_interval_ms = rate > 0 ? (int)(1000 / rate) : 0;
+    burst_requested = true;
+}
+
+// Starts and stops bursts on request and paces their photos
+bool CaptureThread::burstShotDue()
+{
+    if (burst_requested)
+    {
+        burst_requested = false;
+        burst_stop_requested = false;
+        burst_left = burst_count > 0 ? burst_count : -1;
+        burst_clock.start();
+        next_shot_ms = 0;
+        encoder->startBurst();
+    }
+    if (burst_stop_requested)
+    {
+        burst_stop_requested = false;
+        burst_left = 0;
+    }
+    if (burst_left == 0 || burst_clock.elapsed() < next_shot_ms)
+    {
+        return false;
+    }
+
+    // a slow frame does not cause a catch-up series of photos
+    next_shot_ms = qMax(next_shot_ms + burst_interval_ms, burst_clock.elapsed());
+    if (burst_left > 0)
+    {
+        burst_left--;
+    }
+    return true;
+}
+
 void CaptureThread::detectObjects(cv::Mat &frame)
 {
     vector<cv::Rect> objects;
@@ -95,139 +275,60 @@ void CaptureThread::detectObjects(cv::Mat &frame)
     }
 }
 
-static vector<string> getOutputsNames(const cv::dnn::Net &net);
-static void decodeOutLayers(
-    cv::Mat &frame, const vector<cv::Mat> &outs,
-    vector<int> &outClassIds,
-    vector<float> &outConfidences,
-    vector<cv::Rect> &outBoxes);
-
 void CaptureThread::detectObjectsDNN(cv::Mat &frame)
 {
-    int inputWidth = 416;
-    int inputHeight = 416;
-
     if (net.empty())
     {
-        // give the configuration and weight files for the model
-        string modelConfig = QApplication::instance()->applicationDirPath().toStdString() + "/../../../data/yolov3.cfg";
-        string modelWeights = QApplication::instance()->applicationDirPath().toStdString() + "/../../../data/yolov3.weights";
-        net = cv::dnn::readNetFromDarknet(modelConfig, modelWeights);
-        // net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-        // net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
-
-        objectClasses.clear();
-        string name;
-        string namesFile = QApplication::instance()->applicationDirPath().toStdString() + "/../../../data/coco.names";
-
-        ifstream ifs(namesFile.c_str());
-        while (getline(ifs, name))
-            objectClasses.push_back(name);
+        return;
     }
 
-    cv::Mat blob;
-    cv::dnn::blobFromImage(frame, blob, 1 / 255.0, cv::Size(inputWidth, inputHeight), cv::Scalar(0, 0, 0), true, false);
-
-    net.setInput(blob);
+    DnnWorker::preprocess(frame, blob);
+    detections = Detections();
+    DnnWorker::forward(net, blob, frame.size(), decoder, detections);
+    drawDetections(frame, detections);
+}
 
-    // forward
-    vector<cv::Mat> outs;
-    net.forward(outs, getOutputsNames(net));
+// The blob of this frame is prepared while the worker still forwards an earlier one
+void CaptureThread::detectObjectsAsync(cv::Mat &frame, qint64 sequence)
+{
+    DnnWorker::preprocess(frame, blob);
+    dnn_worker->submit(blob, sequence, frame.size());
 
-#ifdef TIME_MEASURE
-    vector<double> layersTimes;
-    double freq = cv::getTickFrequency() / 1000;
-    double t = net.getPerfProfile(layersTimes) / freq;
-    qDebug() << "YOLO: Inference time on a single frame: " << t << "ms";
-#endif
+    if (dnn_worker->takeResult(detections))
+    {
+        lag_frames += sequence - detections.sequence;
+    }
+    drawDetections(frame, detections);
+}
 
-    // remove the bounding boxes with low confidence
-    vector<int> outClassIds;
-    vector<float> outConfidences;
-    vector<cv::Rect> outBoxes;
-    decodeOutLayers(frame, outs, outClassIds, outConfidences, outBoxes);
+// The forward pass is shared with other frames, only the decoding of this one happens here
+void CaptureThread::detectObjectsBatched(cv::Mat &frame, qint64 ticket)
+{
+    vector<cv::Mat> outs;
+    if (!batch_scheduler->wait(ticket, outs))
+    {
+        return;
+    }
+    detections = Detections();
+    decoder.decode(outs, frame.size(), detections.class_ids, detections.confidences, detections.boxes);
+    drawDetections(frame, detections);
+}
 
-    for (size_t i = 0; i < outClassIds.size(); i++)
+void CaptureThread::drawDetections(cv::Mat &frame, const Detections &detections)
+{
+    for (size_t i = 0; i < detections.class_ids.size(); i++)
     {
-        cv::rectangle(frame, outBoxes[i], cv::Scalar(0, 0, 255));
+        cv::rectangle(frame, detections.boxes[i], cv::Scalar(0, 0, 255));
 
         // get the label for the class name and its confidence
-        string label = objectClasses[outClassIds[i]];
-        label += cv::format(":%.2f", outConfidences[i]);
+        string label = objectClasses[detections.class_ids[i]];
+        label += cv::format(":%.2f", detections.confidences[i]);
 
         // display the label at the top of the bounding box
         int baseLine;
         cv::Size labelSize = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseLine);
-        int left = outBoxes[i].x, top = outBoxes[i].y;
+        int left = detections.boxes[i].x, top = detections.boxes[i].y;
         top = max(top, labelSize.height);
         cv::putText(frame, label, cv::Point(left, top), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255));
     }
 }
-
-// Returns the names of the output layers in the neural network
-vector<string> getOutputsNames(const cv::dnn::Net &net)
-{
-    static vector<string> names;
-    vector<int> outLayers = net.getUnconnectedOutLayers(); // Get IDs of output layers
-    vector<string> layersNames = net.getLayerNames();      // Get names of all layers in the network
-    names.resize(outLayers.size());
-    for (size_t i = 0; i < outLayers.size(); ++i)
-        names[i] = layersNames[outLayers[i] - 1];
-
-    return names;
-}
-
-// Decode the output layers and apply confidence thresholding and non-maximum suppression
-void decodeOutLayers(
-    cv::Mat &frame, const vector<cv::Mat> &outs,
-    vector<int> &outClassIds,
-    vector<float> &outConfidences,
-    vector<cv::Rect> &outBoxes)
-{
-    float confThreshold = 0.5; // confidence threshold for filtering weak detections
-    float nmsThreshold = 0.4;  // non-maximum suppression threshold to eliminate redundant boxes
-
-    vector<int> classIds;
-    vector<float> confidences;
-    vector<cv::Rect> boxes;
-
-    // Process the output layers
-    for (size_t i = 0; i < outs.size(); ++i)
-    {
-        float *data = (float *)outs[i].data;
-        for (int j = 0; j < outs[i].rows; ++j, data += outs[i].cols)
-        {
-            cv::Mat scores = outs[i].row(j).colRange(5, outs[i].cols);
-            cv::Point classIdPoint;
-            double confidence;
-            // Get the value and location of the maximum score among object classes
-            cv::minMaxLoc(scores, 0, &confidence, 0, &classIdPoint);
-            if (confidence > confThreshold) // Apply confidence thresholding
-            {
-                // Convert detected bounding box to frame coordinates
-                int centerX = (int)(data[0] * frame.cols);
-                int centerY = (int)(data[1] * frame.rows);
-                int width = (int)(data[2] * frame.cols);
-                int height = (int)(data[3] * frame.rows);
-                int left = centerX - width / 2;
-                int top = centerY - height / 2;
-
-                // Store the result
-                classIds.push_back(classIdPoint.x);
-                confidences.push_back((float)confidence);
-                boxes.push_back(cv::Rect(left, top, width, height));
-            }
-        }
-    }
-
-    // Apply non-maximum suppression to remove redundancy
-    vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, confidences, confThreshold, nmsThreshold, indices);
-    for (size_t i = 0; i < indices.size(); ++i)
-    {
-        int idx = indices[i];
-        outClassIds.push_back(classIds[idx]);
-        outBoxes.push_back(boxes[idx]);
-        outConfidences.push_back(confidences[idx]);
-    }
-}
@@ -0,0 +1,128 @@
+#include <QMutexLocker>
+#include <QDebug>
+
+#include "dnn_worker.h"
+
+DnnWorker::DnnWorker(cv::dnn::Net net) : net(net)
+{
+    quit = false;
+    has_input = false;
+    input_sequence = 0;
+    has_result = false;
+    completed = replaced = 0;
+    total_forward_ms = 0;
+}
+
+DnnWorker::~DnnWorker()
+{
+    stop();
+    wait();
+}
+
+void DnnWorker::submit(cv::Mat &blob, qint64 sequence, cv::Size frame_size)
+{
+    QMutexLocker locker(&lock);
+    if (has_input)
+    {
+        replaced++;
+    }
+    cv::swap(input_blob, blob);
+    input_sequence = sequence;
+    input_size = frame_size;
+    has_input = true;
+    input_ready.wakeOne();
+}
+
+bool DnnWorker::takeResult(Detections &detections)
+{
+    QMutexLocker locker(&lock);
+    if (!has_result)
+    {
+        return false;
+    }
+    detections = std::move(result);
+    has_result = false;
+    return true;
+}
+
+void DnnWorker::stop()
+{
+    QMutexLocker locker(&lock);
+    quit = true;
+    input_ready.wakeOne();
+}
+
+DnnWorker::Stats DnnWorker::stats()
+{
+    QMutexLocker locker(&lock);
+    Stats stats;
+    stats.completed = completed;
+    stats.replaced = replaced;
+    stats.forward_ms = completed > 0 ? total_forward_ms / completed : 0.0;
+    return stats;
+}
+
+void DnnWorker::run()
+{
+    cv::Mat blob;
+    while (true)
+    {
+        qint64 sequence;
+        cv::Size frame_size;
+        lock.lock();
+        while (!has_input && !quit)
+        {
+            input_ready.wait(&lock);
+        }
+        if (quit)
+        {
+            lock.unlock();
+            break;
+        }
+        // the slot gets the buffer of the previous pass, the capture thread fills it next
+        cv::swap(blob, input_blob);
+        sequence = input_sequence;
+        frame_size = input_size;
+        has_input = false;
+        lock.unlock();
+
+        Detections detections;
+        detections.sequence = sequence;
+        int64 t0 = cv::getTickCount();
+        forward(net, blob, frame_size, decoder, detections);
+        double forward_ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+
+        lock.lock();
+        result = std::move(detections);
+        has_result = true;
+        completed++;
+        total_forward_ms += forward_ms;
+        lock.unlock();
+    }
+}
+
+void DnnWorker::preprocess(const cv::Mat &frame, cv::Mat &blob)
+{
+    int inputWidth = 416;
+    int inputHeight = 416;
+    cv::dnn::blobFromImage(frame, blob, 1 / 255.0, cv::Size(inputWidth, inputHeight), cv::Scalar(0, 0, 0), true, false);
+}
+
+void DnnWorker::forward(cv::dnn::Net &net, const cv::Mat &blob, cv::Size frame_size, YoloDecoder &decoder, Detections &detections)
+{
+    net.setInput(blob);
+
+    // forward
+    vector<cv::Mat> outs;
+    net.forward(outs, net.getUnconnectedOutLayersNames());
+
+#ifdef TIME_MEASURE
+    vector<double> layersTimes;
+    double freq = cv::getTickFrequency() / 1000;
+    double t = net.getPerfProfile(layersTimes) / freq;
+    qDebug() << "YOLO: Inference time on a single frame: " << t << "ms";
+#endif
+
+    // remove the bounding boxes with low confidence
+    decoder.decode(outs, frame_size, detections.class_ids, detections.confidences, detections.boxes);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "opencv2/dnn.hpp"
+
+#include "yolo_decoder.h"
+
+using namespace std;
+
+// Objects found by one forward pass, in the coordinates of the frame it was computed on
+struct Detections
+{
+    qint64 sequence; // number of the frame the blob was made from, -1 before the first result
+    vector<int> class_ids;
+    vector<float> confidences;
+    vector<cv::Rect> boxes;
+
+    Detections() : sequence(-1) {}
+};
+
+/*
+ * Runs the YOLOv3 forward pass and decoding on a thread of its own, so that
+ * the capture loop keeps its frame rate while a frame takes 100 ms or more to
+ * infer. The capture thread prepares the blob of every frame while the worker
+ * is still busy with an earlier one and puts it into the input slot, where it
+ * replaces a blob that is still waiting, so the worker always starts on the
+ * newest frame. Blobs are swapped in and out of the slot rather than copied,
+ * so the buffers are reused from frame to frame.
+ *
+ * Every result carries the sequence number of the frame it belongs to. The
+ * capture thread draws the latest result on the latest frame, and the number
+ * of frames it lags behind is counted.
+ */
+class DnnWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    // The worker owns the net until it has stopped
+    explicit DnnWorker(cv::dnn::Net net);
+    ~DnnWorker();
+
+    // Called from the capture thread
+    void submit(cv::Mat &blob, qint64 sequence, cv::Size frame_size); // swaps the blob with a free buffer
+    bool takeResult(Detections &detections); // false if nothing new finished since the last call
+    void stop();
+
+    struct Stats
+    {
+        int completed;
+        int replaced; // blobs replaced by a newer one before they were forwarded
+        double forward_ms; // average per forward pass
+    };
+    Stats stats();
+
+    // The synchronous and batched paths of the capture thread use the same stages
+    static void preprocess(const cv::Mat &frame, cv::Mat &blob);
+    static void forward(cv::dnn::Net &net, const cv::Mat &blob, cv::Size frame_size, YoloDecoder &decoder,
+                        Detections &detections);
+
+protected:
+    void run() override;
+
+private:
+    cv::dnn::Net net;
+    YoloDecoder decoder;
+
+    QMutex lock;
+    QWaitCondition input_ready;
+    bool quit;
+
+    // input slot
+    bool has_input;
+    cv::Mat input_blob;
+    qint64 input_sequence;
+    cv::Size input_size;
+
+    // latest result
+    bool has_result;
+    Detections result;
+
+    // metrics, guarded by lock
+    int completed;
+    int replaced;
+    double total_forward_ms;
+};
@@ -1,8 +1,17 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include "mainwindow.h"
+#include "batch_scheduler.h"
 
 int main(int argc, char *argv[])
 {
+    // --check-batching path/to/image verifies that batched inference finds the same boxes as single passes
+    if (argc >= 3 && QString(argv[1]) == "--check-batching")
+    {
+        QCoreApplication app(argc, argv);
+        return BatchScheduler::checkBatching(QString(argv[2]));
+    }
+
     QApplication app(argc, argv);
     MainWindow window;
     window.setWindowTitle("Detective");
@@ -9,19 +9,30 @@
 #include <QIcon>
 #include <QStandardItem>
 #include <QSize>
+#include <QInputDialog>
 
 #include "opencv2/videoio.hpp"
 
 #include "mainwindow.h"
 #include "utilities.h"
+#include "model_store.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent)
     , fileMenu(nullptr)
     , capturer(nullptr)
 {
+    burst_count = 10;
+    burst_rate = 0.0;
+    continuous_rate = 2.0;
     initUI();
     data_lock = new QMutex();
+
+    // YOLOv3 loads in the background while the window comes up
+    ModelStore *store = ModelStore::instance();
+    connect(store, &ModelStore::loadProgress, this, &MainWindow::modelLoadProgress);
+    connect(store, &ModelStore::loadFailed, this, &MainWindow::modelLoadFailed);
+    store->loadAll();
 }
 
 MainWindow::~MainWindow()
@@ -50,6 +61,17 @@ void MainWindow::initUI()
     tools_layout->addWidget(shutterButton, 0, 0, Qt::AlignHCenter);
     connect(shutterButton, SIGNAL(clicked(bool)), this, SLOT(takePhoto()));
 
+    burstButton = new QPushButton(this);
+    burstButton->setText("Burst");
+    tools_layout->addWidget(burstButton, 0, 1, Qt::AlignHCenter);
+    connect(burstButton, SIGNAL(clicked(bool)), this, SLOT(takeBurst()));
+
+    continuousButton = new QPushButton(this);
+    continuousButton->setText("Continuous");
+    continuousButton->setCheckable(true);
+    tools_layout->addWidget(continuousButton, 0, 2, Qt::AlignHCenter);
+    connect(continuousButton, SIGNAL(toggled(bool)), this, SLOT(toggleContinuousPhotos(bool)));
+
     // list of saved photos
     saved_list = new QListView(this);
     saved_list->setViewMode(QListView::IconMode);
@@ -81,6 +103,28 @@ void MainWindow::createActions()
     fileMenu->addAction(cameraInfoAction);
     openCameraAction = new QAction("&Open Camera", this);
     fileMenu->addAction(openCameraAction);
+    openVideoAction = new QAction("Open &Video File...", this);
+    fileMenu->addAction(openVideoAction);
+    openStreamAction = new QAction("Open &Stream URL...", this);
+    fileMenu->addAction(openStreamAction);
+    fastReplayAction = new QAction("Fast &Replay of Video Files", this);
+    fastReplayAction->setCheckable(true);
+    fileMenu->addAction(fastReplayAction);
+    // where YOLOv3 runs, applies to the next camera or video that is opened
+    fileMenu->addSeparator();
+    const char *inference_names[3] = {"Inference on the &Capture Thread", "&Asynchronous Inference", "Ba&tched Inference"};
+    QActionGroup *inference_group = new QActionGroup(this);
+    for (int i = 0; i < 3; i++)
+    {
+        inferenceActions[i] = new QAction(inference_names[i], this);
+        inferenceActions[i]->setCheckable(true);
+        inference_group->addAction(inferenceActions[i]);
+        fileMenu->addAction(inferenceActions[i]);
+    }
+    inferenceActions[CaptureThread::ASYNCHRONOUS]->setChecked(true);
+    fileMenu->addSeparator();
+    burstSettingsAction = new QAction("&Burst Settings...", this);
+    fileMenu->addAction(burstSettingsAction);
     exitAction = new QAction("E&xit", this);
     fileMenu->addAction(exitAction);
 
@@ -88,6 +132,9 @@ void MainWindow::createActions()
     connect(exitAction, SIGNAL(triggered(bool)), QApplication::instance(), SLOT(quit()));
     connect(cameraInfoAction, SIGNAL(triggered(bool)), this, SLOT(showCameraInfo()));
     connect(openCameraAction, SIGNAL(triggered(bool)), this, SLOT(openCamera()));
+    connect(openVideoAction, SIGNAL(triggered(bool)), this, SLOT(openVideo()));
+    connect(openStreamAction, SIGNAL(triggered(bool)), this, SLOT(openStream()));
+    connect(burstSettingsAction, SIGNAL(triggered(bool)), this, SLOT(changeBurstSettings()));
 }
 
 void MainWindow::showCameraInfo()
@@ -104,20 +151,68 @@ void MainWindow::showCameraInfo()
 
 void MainWindow::openCamera()
 {
-    if(capturer != nullptr) {
+    int camID = 0;
+    startCapture(new CaptureThread(camID, data_lock), QString("Capturing Camera %1").arg(camID));
+}
+
+void MainWindow::openVideo()
+{
+    QString path = QFileDialog::getOpenFileName(
+        this, "Open Video File", QDir::homePath(), "Videos (*.mp4 *.avi *.mov *.mkv *.m4v);;All files (*)");
+    if (path.isEmpty())
+    {
+        return;
+    }
+    startCapture(new CaptureThread(path, data_lock), QString("Playing %1").arg(QFileInfo(path).fileName()));
+}
+
+void MainWindow::openStream()
+{
+    bool ok = false;
+    QString url = QInputDialog::getText(
+        this, "Open Stream URL", "Stream URL (e.g. rtsp://host:554/stream):", QLineEdit::Normal, "", &ok);
+    if (!ok || url.trimmed().isEmpty())
+    {
+        return;
+    }
+    startCapture(new CaptureThread(url.trimmed(), data_lock), QString("Streaming %1").arg(url.trimmed()));
+}
+
+void MainWindow::startCapture(CaptureThread *thread, QString status)
+{
+    // a continuous series belongs to the previous source, which may be deleted below
+    continuousButton->setChecked(false);
+
+    if (capturer != nullptr)
+    {
         // if a thread is already running, stop it
         capturer->setRunning(false);
         disconnect(capturer, &CaptureThread::frameCaptured, this, &MainWindow::updateFrame);
         disconnect(capturer, &CaptureThread::photoTaken, this, &MainWindow::appendSavedPhoto);
-        connect(capturer, &CaptureThread::finished, capturer, &CaptureThread::deleteLater);
+        if (capturer->isFinished())
+        {
+            // e.g. a video file that has ended, finished() was emitted already
+            delete capturer;
+        }
+        else
+        {
+            connect(capturer, &CaptureThread::finished, capturer, &CaptureThread::deleteLater);
+        }
     }
     
-    int camID = 0;
-    capturer = new CaptureThread(camID, data_lock);
+    capturer = thread;
+    capturer->setReplayMode(fastReplayAction->isChecked() ? CaptureThread::FAST : CaptureThread::REALTIME);
+    for (int i = 0; i < 3; i++)
+    {
+        if (inferenceActions[i]->isChecked())
+        {
+            capturer->setInferenceMode(static_cast<CaptureThread::InferenceMode>(i));
+        }
+    }
     connect(capturer, &CaptureThread::frameCaptured, this, &MainWindow::updateFrame);
     connect(capturer, &CaptureThread::photoTaken, this, &MainWindow::appendSavedPhoto);
     capturer->start();
-    mainStatusLabel->setText(QString("Capturing Camera %1").arg(camID));
+    mainStatusLabel->setText(status);
 }
 
 
@@ -160,7 +255,7 @@ void MainWindow::populateSavedList()
         nameFilters, QDir::NoDotAndDotDot | QDir::Files, QDir::Name);
 
     foreach(QFileInfo photo, files) {
-        QString name = photo.baseName();
+        QString name = photo.completeBaseName();
         QStandardItem *item = new QStandardItem();
         list_model->appendRow(item);
         QModelIndex index = list_model->indexFromItem(item);
@@ -169,13 +264,92 @@ void MainWindow::populateSavedList()
     }
 }
 
-void MainWindow::appendSavedPhoto(QString name)
+// The thumbnail was scaled by the photo encoder, the photo itself is not read again
+void MainWindow::appendSavedPhoto(QString name, QImage thumbnail)
 {
-    QString photo_path = Utilities::getPhotoPath(name, "jpg");
     QStandardItem *item = new QStandardItem();
     list_model->appendRow(item);
     QModelIndex index = list_model->indexFromItem(item);
-    list_model->setData(index, QPixmap(photo_path).scaledToHeight(145), Qt::DecorationRole);
+    list_model->setData(index, QPixmap::fromImage(thumbnail), Qt::DecorationRole);
     list_model->setData(index, name, Qt::DisplayRole);
     saved_list->scrollTo(index);
+
+    if (capturer != nullptr)
+    {
+        PhotoEncoder::Stats stats = capturer->photoStats();
+        mainStatusLabel->setText(
+            QString("Photos: %1 saved, %2 dropped, %3 pending, %4 ms to encode, %5 photos/s")
+                .arg(stats.saved).arg(stats.dropped).arg(stats.pending)
+                .arg(stats.encode_ms, 0, 'f', 1).arg(stats.photos_per_s, 0, 'f', 1));
+    }
+}
+
+void MainWindow::modelLoadProgress(int loaded, int total, QString name)
+{
+    if (capturer != nullptr)
+    {
+        return;
+    }
+    if (loaded < total)
+    {
+        mainStatusLabel->setText(QString("Loading %1 (%2/%3)...").arg(name).arg(loaded + 1).arg(total));
+    }
+    else
+    {
+        mainStatusLabel->setText("Object Detection is Ready");
+    }
+}
+
+void MainWindow::modelLoadFailed(QString error)
+{
+    QMessageBox::warning(this, "Model Loading", error);
+}
+
+void MainWindow::takeBurst()
+{
+    if (capturer != nullptr)
+    {
+        capturer->startBurst(burst_count, burst_rate);
+    }
+}
+
+void MainWindow::toggleContinuousPhotos(bool on)
+{
+    if (capturer == nullptr)
+    {
+        return;
+    }
+    if (on)
+    {
+        capturer->startBurst(0, continuous_rate);
+    }
+    else
+    {
+        capturer->stopBurst();
+    }
+}
+
+void MainWindow::changeBurstSettings()
+{
+    bool ok = false;
+    int count = QInputDialog::getInt(this, "Burst Settings", "Photos per burst:", burst_count, 1, 1000, 1, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    double rate = QInputDialog::getDouble(
+        this, "Burst Settings", "Burst rate in photos per second (0 for every frame):", burst_rate, 0, 120, 1, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    double continuous = QInputDialog::getDouble(
+        this, "Burst Settings", "Continuous rate in photos per second (0 for every frame):", continuous_rate, 0, 120, 1, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    burst_count = count;
+    burst_rate = rate;
+    continuous_rate = continuous;
 }
\ No newline at end of file
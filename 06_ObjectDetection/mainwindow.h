@@ -3,6 +3,7 @@
 #include <QMainWindow>
 #include <QMenuBar>
 #include <QAction>
+#include <QActionGroup>
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QStatusBar>
@@ -30,25 +31,45 @@ private:
     void initUI();
     void createActions();
     void populateSavedList();
+    void startCapture(CaptureThread *thread, QString status);
 
 private slots:
     void showCameraInfo();
     void openCamera();
+    void openVideo();
+    void openStream();
     void updateFrame(cv::Mat*);
     void takePhoto();
-    void appendSavedPhoto(QString name);
+    void appendSavedPhoto(QString name, QImage thumbnail);
+    void takeBurst();
+    void toggleContinuousPhotos(bool on);
+    void changeBurstSettings();
+    void modelLoadProgress(int loaded, int total, QString name);
+    void modelLoadFailed(QString error);
 
 private:
     QMenu *fileMenu;
 
     QAction *cameraInfoAction;
     QAction *openCameraAction;
+    QAction *openVideoAction;
+    QAction *openStreamAction;
+    QAction *fastReplayAction;
+    QAction *inferenceActions[3];
+    QAction *burstSettingsAction;
     QAction *exitAction;
 
     QGraphicsScene *imageScene;
     QGraphicsView *imageView;
 
     QPushButton *shutterButton;
+    QPushButton *burstButton;
+    QPushButton *continuousButton;
+
+    // burst photos, a rate of 0 takes every frame
+    int burst_count;
+    double burst_rate;
+    double continuous_rate;
 
     QListView *saved_list;
     QStandardItemModel *list_model;
@@ -0,0 +1,170 @@
+#include <QApplication>
+#include <QFile>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QDebug>
+
+#include "model_store.h"
+
+ModelStore *ModelStore::instance()
+{
+    // never deleted, capture threads may still check nets in while the application exits
+    static ModelStore *store = new ModelStore();
+    return store;
+}
+
+ModelStore::ModelStore() : state(NOT_STARTED), scheduler(nullptr)
+{
+}
+
+void ModelStore::loadAll()
+{
+    QMutexLocker locker(&lock);
+    if (state != NOT_STARTED)
+    {
+        return;
+    }
+    state = LOADING;
+    QThreadPool::globalInstance()->start([this]()
+                                         { loadModels(); });
+}
+
+bool ModelStore::isLoaded()
+{
+    QMutexLocker locker(&lock);
+    return state == LOADED;
+}
+
+void ModelStore::loadModels()
+{
+    QString data_dir = QCoreApplication::applicationDirPath() + "/../../../data/";
+    QString load_error;
+    QString config_path = data_dir + "yolov3.cfg";
+    QString weights_path = data_dir + "yolov3.weights";
+    vector<string> names;
+    cv::dnn::Net net;
+
+    emit loadProgress(0, 2, "class names");
+    QFile names_file(data_dir + "coco.names");
+    if (names_file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QTextStream stream(&names_file);
+        while (!stream.atEnd())
+        {
+            names.push_back(stream.readLine().toStdString());
+        }
+    }
+    else
+    {
+        load_error = "Can't read " + names_file.fileName() + ": " + names_file.errorString();
+    }
+
+    if (load_error.isEmpty())
+    {
+        emit loadProgress(1, 2, "YOLOv3 network");
+        try
+        {
+            net = cv::dnn::readNetFromDarknet(config_path.toStdString(), weights_path.toStdString());
+        }
+        catch (const cv::Exception &e)
+        {
+            load_error = "Can't load YOLOv3 from " + data_dir + ": " + QString::fromStdString(e.what());
+        }
+    }
+
+    QMutexLocker locker(&lock);
+    if (net.empty())
+    {
+        state = FAILED;
+        error = load_error;
+        changed.wakeAll();
+        locker.unlock();
+        qWarning() << error;
+        emit loadFailed(error);
+        return;
+    }
+    yolo_config_path = config_path;
+    yolo_weights_path = weights_path;
+    class_names.swap(names);
+    free_nets << net;
+    state = LOADED;
+    changed.wakeAll();
+    locker.unlock();
+    emit loadProgress(2, 2, "");
+}
+
+cv::dnn::Net ModelStore::checkoutYolo()
+{
+    loadAll();
+    QMutexLocker locker(&lock);
+    while (state == LOADING)
+    {
+        changed.wait(&lock);
+    }
+    if (state == FAILED)
+    {
+        return cv::dnn::Net();
+    }
+    if (!free_nets.isEmpty())
+    {
+        return free_nets.takeLast();
+    }
+    // several pipelines at once, the paths never change once loaded
+    locker.unlock();
+    qDebug() << "building another YOLOv3 network";
+    try
+    {
+        return cv::dnn::readNetFromDarknet(yolo_config_path.toStdString(), yolo_weights_path.toStdString());
+    }
+    catch (const cv::Exception &e)
+    {
+        qWarning() << "Can't build another YOLOv3 network:" << e.what();
+        return cv::dnn::Net();
+    }
+}
+
+void ModelStore::checkin(const cv::dnn::Net &net)
+{
+    if (net.empty())
+    {
+        return;
+    }
+    QMutexLocker locker(&lock);
+    free_nets << net;
+}
+
+vector<string> ModelStore::classNames()
+{
+    QMutexLocker locker(&lock);
+    return class_names;
+}
+
+BatchScheduler *ModelStore::batchScheduler()
+{
+    QMutexLocker locker(&scheduler_lock);
+    if (scheduler != nullptr)
+    {
+        return scheduler;
+    }
+    cv::dnn::Net net = checkoutYolo();
+    if (net.empty())
+    {
+        return nullptr;
+    }
+    scheduler = new BatchScheduler(net);
+    scheduler->start();
+    // the scheduler thread must not outlive the application
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &ModelStore::stopScheduler);
+    return scheduler;
+}
+
+void ModelStore::stopScheduler()
+{
+    QMutexLocker locker(&scheduler_lock);
+    if (scheduler == nullptr)
+    {
+        return;
+    }
+    scheduler->stop();
+    scheduler->wait();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <string>
+#include <vector>
+#include "opencv2/dnn.hpp"
+
+#include "batch_scheduler.h"
+
+using namespace std;
+
+/*
+ * Process-wide store of the YOLOv3 model. yolov3.cfg, yolov3.weights (about
+ * 240 MB) and coco.names are read once, in the background right after start,
+ * instead of on the first frame of every capture thread. Progress and
+ * failures are reported through signals.
+ *
+ * A cv::dnn::Net keeps its intermediate blobs between forward passes and must
+ * not run on two threads at once, so each pipeline checks a net out for as
+ * long as it runs and checks it back in when it stops; reopening the camera
+ * gets the same net back. If several pipelines run at once, further nets are
+ * built from the files again. The file contents are not kept in memory, every
+ * net holds a full copy of the weights anyway.
+ *
+ * Pipelines that batch their frames share one BatchScheduler instead, which
+ * holds a net of its own for as long as the application runs.
+ */
+class ModelStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ModelStore *instance();
+
+    void loadAll(); // starts loading in the background, only the first call does anything
+    bool isLoaded();
+
+    // Blocks until the model is loaded, an empty net if it could not be loaded
+    cv::dnn::Net checkoutYolo();
+    void checkin(const cv::dnn::Net &net);
+    vector<string> classNames(); // empty until loaded
+    // Blocks until the model is loaded, nullptr if it could not be loaded
+    BatchScheduler *batchScheduler();
+
+signals:
+    void loadProgress(int loaded, int total, QString name);
+    void loadFailed(QString error);
+
+private:
+    ModelStore();
+    void loadModels(); // on the loader thread
+    void stopScheduler();
+
+private:
+    enum State
+    {
+        NOT_STARTED,
+        LOADING,
+        LOADED,
+        FAILED,
+    };
+
+    QMutex lock;
+    QWaitCondition changed;
+    State state;
+    QString error;
+    QString yolo_config_path;
+    QString yolo_weights_path;
+    vector<string> class_names;
+    QList<cv::dnn::Net> free_nets;
+
+    QMutex scheduler_lock;
+    BatchScheduler *scheduler;
+};
@@ -0,0 +1,99 @@
+#include <QDebug>
+
+#include "utilities.h"
+#include "photo_encoder.h"
+
+PhotoEncoder::PhotoEncoder(int max_pending, QObject *parent) : QObject(parent), max_pending(max_pending)
+{
+    // JPEG encoding is CPU bound, two threads keep up with a camera without starving the capture loop
+    pool.setMaxThreadCount(2);
+    saved = dropped = pending = 0;
+    total_encode_ms = 0.0;
+}
+
+PhotoEncoder::~PhotoEncoder()
+{
+    // photos that were taken are still written
+    pool.waitForDone();
+}
+
+void PhotoEncoder::startBurst()
+{
+    QMutexLocker locker(&lock);
+    saved = dropped = 0;
+    total_encode_ms = 0.0;
+    burst_clock.start();
+}
+
+bool PhotoEncoder::submit(const cv::Mat &frame, QString name)
+{
+    {
+        QMutexLocker locker(&lock);
+        if (pending >= max_pending)
+        {
+            dropped++;
+            return false;
+        }
+        pending++;
+        if (!burst_clock.isValid())
+        {
+            burst_clock.start();
+        }
+    }
+
+    // the capture loop reuses its frame buffer
+    cv::Mat copy = frame.clone();
+    pool.start([this, copy, name]()
+               { encode(copy, name); });
+    return true;
+}
+
+void PhotoEncoder::encode(cv::Mat frame, QString name)
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = cv::imwrite(Utilities::getPhotoPath(name, "jpg").toStdString(), frame);
+    double ms = timer.nsecsElapsed() / 1e6;
+
+    // the saved list shows photos 145 pixels high
+    QImage thumbnail;
+    if (ok)
+    {
+        double scale = 145.0 / frame.rows;
+        cv::Mat small;
+        cv::resize(frame, small, cv::Size(), scale, scale, cv::INTER_AREA);
+        cv::cvtColor(small, small, cv::COLOR_BGR2RGB);
+        thumbnail = QImage(small.data, small.cols, small.rows, small.step, QImage::Format_RGB888).copy();
+    }
+
+    {
+        QMutexLocker locker(&lock);
+        pending--;
+        if (ok)
+        {
+            saved++;
+            total_encode_ms += ms;
+        }
+    }
+    if (ok)
+    {
+        emit photoSaved(name, thumbnail);
+    }
+    else
+    {
+        qWarning() << "Can't write photo" << name;
+    }
+}
+
+PhotoEncoder::Stats PhotoEncoder::stats()
+{
+    QMutexLocker locker(&lock);
+    Stats s;
+    s.saved = saved;
+    s.dropped = dropped;
+    s.pending = pending;
+    s.encode_ms = saved > 0 ? total_encode_ms / saved : 0.0;
+    double elapsed_s = burst_clock.isValid() ? burst_clock.elapsed() / 1000.0 : 0.0;
+    s.photos_per_s = elapsed_s > 0 ? saved / elapsed_s : 0.0;
+    return s;
+}
@@ -0,0 +1,126 @@
+#include <cfloat>
+
+#include "opencv2/core/hal/intrin.hpp"
+#include "opencv2/dnn.hpp"
+
+#include "yolo_decoder.h"
+
+YoloDecoder::YoloDecoder(float conf_threshold, float nms_threshold) : conf_threshold(conf_threshold), nms_threshold(nms_threshold)
+{
+    // YOLOv3 at 416x416 leaves a few dozen candidates per frame above the usual thresholds
+    candidate_ids.reserve(256);
+    candidate_confidences.reserve(256);
+    candidate_boxes.reserve(256);
+}
+
+// Index of the largest of n scores, the first one on ties
+static int argmax(const float *scores, int n, float &best)
+{
+    int best_index = 0;
+    best = -FLT_MAX;
+    int i = 0;
+#if CV_SIMD128
+    if (n >= 4)
+    {
+        // every lane keeps the maximum of its own column and where it was found
+        cv::v_float32x4 lane_max = cv::v_load(scores);
+        cv::v_int32x4 lane_index(0, 1, 2, 3);
+        cv::v_int32x4 index = lane_index;
+        cv::v_int32x4 step = cv::v_setall_s32(4);
+        for (i = 4; i + 4 <= n; i += 4)
+        {
+            index = index + step;
+            cv::v_float32x4 v = cv::v_load(scores + i);
+            cv::v_float32x4 greater = v > lane_max;
+            lane_max = cv::v_select(greater, v, lane_max);
+            lane_index = cv::v_select(cv::v_reinterpret_as_s32(greater), index, lane_index);
+        }
+        float maxima[4];
+        int indices[4];
+        cv::v_store(maxima, lane_max);
+        cv::v_store(indices, lane_index);
+        for (int k = 0; k < 4; k++)
+        {
+            if (maxima[k] > best || (maxima[k] == best && indices[k] < best_index))
+            {
+                best = maxima[k];
+                best_index = indices[k];
+            }
+        }
+    }
+#endif
+    for (; i < n; i++)
+    {
+        if (scores[i] > best)
+        {
+            best = scores[i];
+            best_index = i;
+        }
+    }
+    return best_index;
+}
+
+void YoloDecoder::decode(const vector<cv::Mat> &outs, cv::Size frame_size,
+                         vector<int> &class_ids, vector<float> &confidences, vector<cv::Rect> &boxes)
+{
+    candidate_ids.clear();
+    candidate_confidences.clear();
+    candidate_boxes.clear();
+
+    for (size_t i = 0; i < outs.size(); ++i)
+    {
+        CV_Assert(outs[i].type() == CV_32F && outs[i].isContinuous());
+        int classes = outs[i].cols - 5;
+        const float *data = outs[i].ptr<float>();
+        for (int j = 0; j < outs[i].rows; ++j, data += outs[i].cols)
+        {
+            // the objectness bounds every class score of the row
+            if (data[4] <= conf_threshold)
+            {
+                continue;
+            }
+
+            const float *scores = data + 5;
+            int class_id = -1;
+            float confidence = 0;
+            if (whitelist.empty())
+            {
+                class_id = argmax(scores, classes, confidence);
+            }
+            else
+            {
+                for (size_t k = 0; k < whitelist.size(); k++)
+                {
+                    if (whitelist[k] < classes && scores[whitelist[k]] > confidence)
+                    {
+                        confidence = scores[whitelist[k]];
+                        class_id = whitelist[k];
+                    }
+                }
+            }
+            if (class_id < 0 || confidence <= conf_threshold)
+            {
+                continue;
+            }
+
+            // Convert detected bounding box to frame coordinates
+            int centerX = (int)(data[0] * frame_size.width);
+            int centerY = (int)(data[1] * frame_size.height);
+            int width = (int)(data[2] * frame_size.width);
+            int height = (int)(data[3] * frame_size.height);
+            candidate_ids.push_back(class_id);
+            candidate_confidences.push_back(confidence);
+            candidate_boxes.push_back(cv::Rect(centerX - width / 2, centerY - height / 2, width, height));
+        }
+    }
+
+    // Apply non-maximum suppression to remove redundancy
+    cv::dnn::NMSBoxes(candidate_boxes, candidate_confidences, conf_threshold, nms_threshold, indices);
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        int idx = indices[i];
+        class_ids.push_back(candidate_ids[idx]);
+        confidences.push_back(candidate_confidences[idx]);
+        boxes.push_back(candidate_boxes[idx]);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+using namespace std;
+
+/*
+ * Turns the output layers of YOLOv3 into boxes. Each of the ~10k candidate
+ * rows holds the box, the objectness in column 4 and one score per class.
+ * OpenCV's region layer has already multiplied the class scores by the
+ * objectness, so a row whose objectness is not above the threshold can't have
+ * a class above it either; those rows, nearly all of them, are skipped
+ * after reading a single float. Only the survivors get an argmax over their
+ * class scores, four at a time with OpenCV's universal intrinsics, or just
+ * over the classes of the whitelist if one is set.
+ *
+ * The candidate arrays are kept between frames, so a decoder that is reused
+ * does not allocate once they have grown to the usual number of candidates.
+ * A decoder must not be shared between threads.
+ */
+class YoloDecoder
+{
+public:
+    explicit YoloDecoder(float conf_threshold = 0.5f, float nms_threshold = 0.4f);
+
+    // Only these classes are scored, all of them if the list is empty
+    void setClassWhitelist(const vector<int> &classes) { whitelist = classes; };
+    void decode(const vector<cv::Mat> &outs, cv::Size frame_size,
+                vector<int> &class_ids, vector<float> &confidences, vector<cv::Rect> &boxes);
+
+private:
+    float conf_threshold;
+    float nms_threshold;
+    vector<int> whitelist;
+
+    // candidates before non-maximum suppression
+    vector<int> candidate_ids;
+    vector<float> candidate_confidences;
+    vector<cv::Rect> candidate_boxes;
+    vector<int> indices;
+};
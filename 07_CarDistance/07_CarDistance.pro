@@ -23,5 +23,5 @@ unix: mac {
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 # Input
-HEADERS += capture_thread.h mainwindow.h utilities.h
-SOURCES += capture_thread.cpp main.cpp mainwindow.cpp utilities.cpp
+HEADERS += capture_thread.h mainwindow.h utilities.h model_store.h photo_encoder.h batch_scheduler.h yolo_decoder.h
+SOURCES += capture_thread.cpp main.cpp mainwindow.cpp utilities.cpp model_store.cpp photo_encoder.cpp batch_scheduler.cpp yolo_decoder.cpp
@@ -0,0 +1,252 @@
+#include <QMutexLocker>
+#include <QDebug>
+
+#include "model_store.h"
+#include "yolo_decoder.h"
+#include "batch_scheduler.h"
+
+BatchScheduler::BatchScheduler(cv::dnn::Net net, int max_batch, int max_wait_ms) : net(net), max_batch(max_batch), max_wait_ms(max_wait_ms)
+{
+    next_ticket = 0;
+    client_depth = 0;
+    quit = false;
+    batches = frames = 0;
+    total_forward_ms = 0;
+}
+
+BatchScheduler::~BatchScheduler()
+{
+    stop();
+    wait();
+}
+
+void BatchScheduler::addClient(int depth)
+{
+    QMutexLocker locker(&lock);
+    client_depth += depth;
+}
+
+void BatchScheduler::removeClient(int depth)
+{
+    QMutexLocker locker(&lock);
+    client_depth -= depth;
+    // the frames still queued need not wait for that client any more
+    request_added.wakeOne();
+}
+
+qint64 BatchScheduler::submit(const cv::Mat &frame)
+{
+    QMutexLocker locker(&lock);
+    Request request;
+    request.ticket = next_ticket++;
+    request.frame = frame;
+    request.due = QDeadlineTimer(max_wait_ms);
+    requests.enqueue(request);
+    request_added.wakeOne();
+    return request.ticket;
+}
+
+bool BatchScheduler::wait(qint64 ticket, vector<cv::Mat> &outs)
+{
+    QMutexLocker locker(&lock);
+    while (!results.contains(ticket) && !quit)
+    {
+        result_ready.wait(&lock);
+    }
+    if (!results.contains(ticket))
+    {
+        return false;
+    }
+    outs = results.take(ticket);
+    return true;
+}
+
+void BatchScheduler::stop()
+{
+    QMutexLocker locker(&lock);
+    quit = true;
+    request_added.wakeAll();
+    result_ready.wakeAll();
+}
+
+BatchScheduler::Stats BatchScheduler::stats()
+{
+    QMutexLocker locker(&lock);
+    Stats stats;
+    stats.batches = batches;
+    stats.frames = frames;
+    stats.batch_size = batches > 0 ? (double)frames / batches : 0.0;
+    stats.frame_ms = frames > 0 ? total_forward_ms / frames : 0.0;
+    return stats;
+}
+
+// The outputs of one frame of the batch as the rows x cols matrix a single pass
+// returns. Region layers either stack the rows of all images or, for batches
+// of more than one, put the batch first as N x rows x cols
+static cv::Mat sliceOutput(const cv::Mat &out, int index, int count)
+{
+    if (out.dims <= 2)
+    {
+        int rows = out.rows / count;
+        return out.rowRange(index * rows, (index + 1) * rows).clone();
+    }
+    vector<cv::Range> ranges(out.dims, cv::Range::all());
+    ranges[0] = cv::Range(index, index + 1);
+    return out(ranges).clone().reshape(1, out.size[1]);
+}
+
+void BatchScheduler::run()
+{
+    vector<qint64> tickets;
+    vector<cv::Mat> images;
+    cv::Mat blob;
+    vector<cv::Mat> outs;
+    vector<cv::String> out_names = net.getUnconnectedOutLayersNames();
+
+    lock.lock();
+    while (true)
+    {
+        while (requests.isEmpty() && !quit)
+        {
+            request_added.wait(&lock);
+        }
+        if (quit)
+        {
+            break;
+        }
+
+        // wait for more frames until the batch is full, nobody can send more, or the oldest is due.
+        // Frames that queued up during the previous pass may be due already
+        QDeadlineTimer deadline = requests.head().due;
+        while (requests.size() < max_batch && requests.size() < client_depth && !quit)
+        {
+            if (!request_added.wait(&lock, deadline))
+            {
+                break;
+            }
+        }
+        if (quit)
+        {
+            break;
+        }
+
+        tickets.clear();
+        images.clear();
+        while (!requests.isEmpty() && (int)images.size() < max_batch)
+        {
+            Request request = requests.dequeue();
+            tickets.push_back(request.ticket);
+            images.push_back(request.frame);
+        }
+        lock.unlock();
+
+        int64 t0 = cv::getTickCount();
+        cv::dnn::blobFromImages(images, blob, 1 / 255.0, cv::Size(416, 416), cv::Scalar(0, 0, 0), true, false);
+        net.setInput(blob);
+        net.forward(outs, out_names);
+        double forward_ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+
+        // the slices are copied, the net reuses its output blobs on the next pass
+        int count = (int)images.size();
+        vector<vector<cv::Mat>> frame_outs(count);
+        for (int k = 0; k < count; k++)
+        {
+            for (size_t i = 0; i < outs.size(); i++)
+            {
+                frame_outs[k].push_back(sliceOutput(outs[i], k, count));
+            }
+        }
+        images.clear();
+
+        lock.lock();
+        for (int k = 0; k < count; k++)
+        {
+            results.insert(tickets[k], frame_outs[k]);
+        }
+        batches++;
+        frames += count;
+        total_forward_ms += forward_ms;
+        result_ready.wakeAll();
+    }
+    lock.unlock();
+}
+
+// Boxes of one frame, decoded the way the capture threads do it
+static void decodeBoxes(const vector<cv::Mat> &outs, cv::Size size, vector<int> &ids, vector<cv::Rect> &boxes)
+{
+    YoloDecoder decoder;
+    vector<float> confidences;
+    decoder.decode(outs, size, ids, confidences, boxes);
+}
+
+/*
+ * The image and its mirror image are forwarded one at a time and then as one
+ * batch of 2. Batching must not change the result: both frames have to come
+ * back with the same classes, and with boxes that differ by at most a pixel
+ * of rounding.
+ */
+int BatchScheduler::checkBatching(QString image_path)
+{
+    cv::Mat first = cv::imread(image_path.toStdString());
+    if (first.empty())
+    {
+        qWarning() << "Can't read" << image_path;
+        return 1;
+    }
+    cv::Mat second;
+    cv::flip(first, second, 1);
+    cv::dnn::Net net = ModelStore::instance()->checkoutYolo();
+    if (net.empty())
+    {
+        qWarning() << "YOLOv3 is not available";
+        return 1;
+    }
+
+    vector<cv::Mat> frames;
+    frames.push_back(first);
+    frames.push_back(second);
+    vector<vector<int>> single_ids(2), batch_ids(2);
+    vector<vector<cv::Rect>> single_boxes(2), batch_boxes(2);
+    for (int k = 0; k < 2; k++)
+    {
+        cv::Mat blob;
+        vector<cv::Mat> outs;
+        cv::dnn::blobFromImage(frames[k], blob, 1 / 255.0, cv::Size(416, 416), cv::Scalar(0, 0, 0), true, false);
+        net.setInput(blob);
+        net.forward(outs, net.getUnconnectedOutLayersNames());
+        decodeBoxes(outs, frames[k].size(), single_ids[k], single_boxes[k]);
+    }
+
+    // a generous wait, the batch must be formed by the two frames alone
+    BatchScheduler scheduler(net, 2, 1000);
+    scheduler.start();
+    scheduler.addClient(2);
+    qint64 tickets[2] = {scheduler.submit(first), scheduler.submit(second)};
+    for (int k = 0; k < 2; k++)
+    {
+        vector<cv::Mat> outs;
+        if (!scheduler.wait(tickets[k], outs))
+        {
+            qWarning() << "the scheduler stopped before frame" << k << "was done";
+            return 1;
+        }
+        decodeBoxes(outs, frames[k].size(), batch_ids[k], batch_boxes[k]);
+    }
+    scheduler.removeClient(2);
+    Stats stats = scheduler.stats();
+
+    bool same = stats.batches == 1;
+    for (int k = 0; k < 2; k++)
+    {
+        same = same && single_ids[k] == batch_ids[k];
+        for (size_t i = 0; same && i < single_boxes[k].size(); i++)
+        {
+            cv::Rect a = single_boxes[k][i], b = batch_boxes[k][i];
+            same = abs(a.x - b.x) <= 1 && abs(a.y - b.y) <= 1 && abs(a.width - b.width) <= 1 && abs(a.height - b.height) <= 1;
+        }
+        qDebug() << "frame" << k << ":" << single_boxes[k].size() << "boxes one at a time," << batch_boxes[k].size() << "in the batch";
+    }
+    qDebug() << (same ? "batched and single passes agree," : "batched and single passes differ,") << stats.batches
+             << "forward passes for the batch";
+    return same ? 0 : 1;
+}
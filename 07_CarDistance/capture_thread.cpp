@@ -1,10 +1,12 @@
 #include <QTime>
+#include <QElapsedTimer>
 #include <QDebug>
 #include <QApplication>
 
 #include <fstream>
 
 #include "utilities.h"
+#include "model_store.h"
 #include "capture_thread.h"
 
 const int CAR_IDX = 2;
@@ -12,25 +14,100 @@ const int CAR_IDX = 2;
 CaptureThread::CaptureThread(int camera, QMutex *lock) : running(false), cameraID(camera), videoPath(""), data_lock(lock)
 {
     frame_width = frame_height = 0;
+    replay_mode = REALTIME;
     taking_photo = false;
+    encoder = new PhotoEncoder(8, this);
+    connect(encoder, &PhotoEncoder::photoSaved, this, &CaptureThread::photoTaken);
+    burst_count = burst_interval_ms = 0;
+    burst_requested = burst_stop_requested = false;
+    burst_left = 0;
+    next_shot_ms = 0;
+    batched_inference = false;
+    batch_scheduler = nullptr;
+    batch_depth = 1;
+    // only cars are scored, and only when they are confident
+    decoder = YoloDecoder(0.65f, 0.4f);
+    decoder.setClassWhitelist(vector<int>(1, CAR_IDX));
+    viewMode = BIRDEYE;
 }
 
 CaptureThread::CaptureThread(QString videoPath, QMutex *lock) : running(false), cameraID(-1), videoPath(videoPath), data_lock(lock)
 {
     frame_width = frame_height = 0;
+    replay_mode = REALTIME;
     taking_photo = false;
+    encoder = new PhotoEncoder(8, this);
+    connect(encoder, &PhotoEncoder::photoSaved, this, &CaptureThread::photoTaken);
+    burst_count = burst_interval_ms = 0;
+    burst_requested = burst_stop_requested = false;
+    burst_left = 0;
+    next_shot_ms = 0;
+    batched_inference = false;
+    batch_scheduler = nullptr;
+    batch_depth = 1;
+    // only cars are scored, and only when they are confident
+    decoder = YoloDecoder(0.65f, 0.4f);
+    decoder.setClassWhitelist(vector<int>(1, CAR_IDX));
+    viewMode = BIRDEYE;
 }
 
 void CaptureThread::run()
 {
     running = true;
-    cv::VideoCapture cap(cameraID);
-    // cv::VideoCapture cap("/home/kdr2/Videos/WIN_20190123_20_14_56_Pro.mp4");
+    cv::VideoCapture cap;
+    if (videoPath.isEmpty())
+    {
+        cap.open(cameraID);
+    }
+    else
+    {
+        cap.open(videoPath.toStdString());
+    }
+    if (!cap.isOpened())
+    {
+        qWarning() << "Error opening video source" << (videoPath.isEmpty() ? QString::number(cameraID) : videoPath);
+        running = false;
+        return;
+    }
     cv::Mat tmp_frame;
 
     frame_width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
     frame_height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
 
+    // YOLOv3 is loaded once per process by the model store, this only waits while it is still loading.
+    // Batched streams share the net of the scheduler instead of checking out one of their own
+    if (batched_inference)
+    {
+        batch_scheduler = ModelStore::instance()->batchScheduler();
+    }
+    else
+    {
+        net = ModelStore::instance()->checkoutYolo();
+    }
+    objectClasses = ModelStore::instance()->classNames();
+    if (net.empty() && batch_scheduler == nullptr)
+    {
+        qWarning() << "Object detection is not available";
+    }
+    else if (batch_scheduler != nullptr)
+    {
+        // latency doesn't matter in a fast replay, consecutive frames fill the batches
+        batch_depth = isFileSource() && replay_mode == FAST ? batch_scheduler->maxBatch() : 1;
+        batch_scheduler->addClient(batch_depth);
+    }
+
+    // Video files are paced to their own frame rate unless replayed as fast as possible,
+    // cameras and network streams deliver frames at their own pace
+    bool paced = isFileSource() && replay_mode == REALTIME;
+    double source_fps = cap.get(cv::CAP_PROP_FPS);
+    if (source_fps <= 0)
+    {
+        source_fps = 30;
+    }
+    QElapsedTimer replay_clock;
+    replay_clock.start();
+    int frame_count = 0;
+
     while (running)
     {
         cap >> tmp_frame;
@@ -38,13 +115,38 @@ void CaptureThread::run()
         {
             break;
         }
+        frame_count++;
+        if (paced)
+        {
+            qint64 ahead_ms = (qint64)(frame_count * 1000.0 / source_fps) - replay_clock.elapsed();
+            if (ahead_ms > 0)
+            {
+                msleep(ahead_ms);
+            }
+        }
 
-        if (taking_photo)
+        if (taking_photo || burstShotDue())
         {
             takePhoto(tmp_frame);
         }
 
-        detectObjectsDNN(tmp_frame);
+        if (batch_scheduler != nullptr)
+        {
+            // a frame is shown once its result is back, batch_depth - 1 frames later
+            batch_frames.enqueue(qMakePair(tmp_frame, batch_scheduler->submit(tmp_frame)));
+            tmp_frame = cv::Mat();
+            if (batch_frames.size() < batch_depth)
+            {
+                continue;
+            }
+            QPair<cv::Mat, qint64> next = batch_frames.dequeue();
+            tmp_frame = next.first;
+            detectObjectsBatched(tmp_frame, next.second);
+        }
+        else
+        {
+            detectObjectsDNN(tmp_frame);
+        }
 
         cvtColor(tmp_frame, tmp_frame, cv::COLOR_BGR2RGB);
         data_lock->lock();
@@ -52,22 +154,78 @@ void CaptureThread::run()
         data_lock->unlock();
         emit frameCaptured(&frame);
     }
+    if (!videoPath.isEmpty())
+    {
+        double elapsed_s = replay_clock.elapsed() / 1000.0;
+        qDebug() << "replayed" << frame_count << "frames of" << videoPath << "in" << elapsed_s << "s,"
+                 << (elapsed_s > 0 ? frame_count / elapsed_s : 0.0) << "fps";
+    }
+    if (batch_scheduler != nullptr)
+    {
+        // the frames still in flight are not shown, but their results must be collected
+        vector<cv::Mat> outs;
+        while (!batch_frames.isEmpty())
+        {
+            batch_scheduler->wait(batch_frames.dequeue().second, outs);
+        }
+        batch_scheduler->removeClient(batch_depth);
+        BatchScheduler::Stats stats = batch_scheduler->stats();
+        qDebug() << "batched inference:" << stats.frames << "frames in" << stats.batches << "forward passes of"
+                 << stats.batch_size << "frames on average," << stats.frame_ms << "ms per frame";
+        batch_scheduler = nullptr;
+    }
+
     cap.release();
+    ModelStore::instance()->checkin(net);
+    net = cv::dnn::Net();
     running = false;
 }
 
 void CaptureThread::takePhoto(cv::Mat &frame)
 {
-    QString photo_name = Utilities::newPhotoName();
-    QString photo_path = Utilities::getPhotoPath(photo_name, "jpg");
-    cv::imwrite(photo_path.toStdString(), frame);
-    emit photoTaken(photo_name);
+    // encoding and writing happen on the encoder pool, the loop only pays for the copy
+    encoder->submit(frame, Utilities::newPhotoName());
     taking_photo = false;
 }
 
-static void decodeOutLayers(
-    cv::Mat &frame, const vector<cv::Mat> &outs,
-    vector<cv::Rect> &outBoxes);
+void CaptureThread::startBurst(int count, double rate)
+{
+    burst_count = count;
+    burst_interval_ms = rate > 0 ? (int)(1000 / rate) : 0;
+    burst_requested = true;
+}
+
+// Starts and stops bursts on request and paces their photos
+bool CaptureThread::burstShotDue()
+{
+    if (burst_requested)
+    {
+        burst_requested = false;
+        burst_stop_requested = false;
+        burst_left = burst_count > 0 ? burst_count : -1;
+        burst_clock.start();
+        next_shot_ms = 0;
+        encoder->startBurst();
+    }
+    if (burst_stop_requested)
+    {
+        burst_stop_requested = false;
+        burst_left = 0;
+    }
+    if (burst_left == 0 || burst_clock.elapsed() < next_shot_ms)
+    {
+        return false;
+    }
+
+    // a slow frame does not cause a catch-up series of photos
+    next_shot_ms = qMax(next_shot_ms + burst_interval_ms, burst_clock.elapsed());
+    if (burst_left > 0)
+    {
+        burst_left--;
+    }
+    return true;
+}
+
 void distanceBirdEye(cv::Mat &frame, vector<cv::Rect> &cars);
 void distanceEyeLevel(cv::Mat &frame, vector<cv::Rect> &cars);
 
@@ -78,20 +236,7 @@ void CaptureThread::detectObjectsDNN(cv::Mat &frame)
 
     if (net.empty())
     {
-        // give the configuration and weight files for the model
-        string modelConfig = QApplication::instance()->applicationDirPath().toStdString() + "/../../../data/yolov3.cfg";
-        string modelWeights = QApplication::instance()->applicationDirPath().toStdString() + "/../../../data/yolov3.weights";
-        net = cv::dnn::readNetFromDarknet(modelConfig, modelWeights);
-        // net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-        // net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
-
-        objectClasses.clear();
-        string name;
-        string namesFile = QApplication::instance()->applicationDirPath().toStdString() + "/../../../data/coco.names";
-
-        ifstream ifs(namesFile.c_str());
-        while (getline(ifs, name))
-            objectClasses.push_back(name);
+        return;
     }
 
     cv::Mat blob;
@@ -102,10 +247,26 @@ void CaptureThread::detectObjectsDNN(cv::Mat &frame)
     // forward
     vector<cv::Mat> outs;
     net.forward(outs, net.getUnconnectedOutLayersNames());
+    showCars(frame, outs);
+}
 
+// The forward pass is shared with other frames, only the decoding of this one happens here
+void CaptureThread::detectObjectsBatched(cv::Mat &frame, qint64 ticket)
+{
+    vector<cv::Mat> outs;
+    if (batch_scheduler->wait(ticket, outs))
+    {
+        showCars(frame, outs);
+    }
+}
+
+void CaptureThread::showCars(cv::Mat &frame, const vector<cv::Mat> &outs)
+{
     // remove the bounding boxes with low confidence
+    vector<int> outClassIds;
+    vector<float> outConfidences;
     vector<cv::Rect> outBoxes;
-    decodeOutLayers(frame, outs, outBoxes);
+    decoder.decode(outs, frame.size(), outClassIds, outConfidences, outBoxes);
 
     for (size_t i = 0; i < outBoxes.size(); i++)
     {
@@ -121,55 +282,6 @@ void CaptureThread::detectObjectsDNN(cv::Mat &frame)
     }
 }
 
-// Decode the output layers and apply confidence thresholding and non-maximum suppression
-void decodeOutLayers(
-    cv::Mat &frame, const vector<cv::Mat> &outs,
-    vector<cv::Rect> &outBoxes)
-{
-    float confThreshold = 0.65; // confidence threshold
-    float nmsThreshold = 0.4;   // non-maximum suppression threshold
-
-    vector<float> confidences;
-    vector<cv::Rect> boxes;
-
-    // Process the output layers
-    for (size_t i = 0; i < outs.size(); ++i)
-    {
-        float *data = (float *)outs[i].data;
-        for (int j = 0; j < outs[i].rows; ++j, data += outs[i].cols)
-        {
-            cv::Mat scores = outs[i].row(j).colRange(5, outs[i].cols);
-            cv::Point classIdPoint;
-            double confidence;
-            // Get the value and location of the maximum score among object classes
-            cv::minMaxLoc(scores, 0, &confidence, 0, &classIdPoint);
-            if (classIdPoint.x != CAR_IDX) // not a car!
-                continue;
-            if (confidence > confThreshold)
-            {
-                int centerX = (int)(data[0] * frame.cols);
-                int centerY = (int)(data[1] * frame.rows);
-                int width = (int)(data[2] * frame.cols);
-                int height = (int)(data[3] * frame.rows);
-                int left = centerX - width / 2;
-                int top = centerY - height / 2;
-
-                confidences.push_back((float)confidence);
-                boxes.push_back(cv::Rect(left, top, width, height));
-            }
-        }
-    }
-
-    // Apply non-maximum suppression to remove redundancy
-    vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, confidences, confThreshold, nmsThreshold, indices);
-    for (size_t i = 0; i < indices.size(); ++i)
-    {
-        int idx = indices[i];
-        outBoxes.push_back(boxes[idx]);
-    }
-}
-
 void distanceBirdEye(cv::Mat &frame, vector<cv::Rect> &cars)
 {
     if (cars.empty())
@@ -3,12 +3,19 @@
 #include <QString>
 #include <QThread>
 #include <QMutex>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QPair>
 
 #include "opencv2/opencv.hpp"
 #include "opencv2/videoio.hpp"
 #include "opencv2/objdetect.hpp"
 #include "opencv2/dnn.hpp"
 
+#include "photo_encoder.h"
+#include "batch_scheduler.h"
+#include "yolo_decoder.h"
+
 using namespace std;
 
 class CaptureThread : public QThread
@@ -20,6 +27,23 @@ public:
     ~CaptureThread() = default;
     void setRunning(bool run) { running = run; };
     void takePhoto() { taking_photo = true; }
+    // count photos (0 for continuous until stopBurst()) at rate photos per second (0 for every frame)
+    void startBurst(int count, double rate);
+    void stopBurst() { burst_stop_requested = true; };
+    PhotoEncoder::Stats photoStats() { return encoder->stats(); };
+
+    // Pacing of video file sources: REALTIME plays them at their own frame rate,
+    // FAST decodes as fast as possible for offline throughput testing
+    enum ReplayMode
+    {
+        REALTIME,
+        FAST
+    };
+    void setReplayMode(ReplayMode mode) { replay_mode = mode; };
+    bool isFileSource() const { return !videoPath.isEmpty() && !videoPath.contains("://"); };
+
+    // Shares forward passes with other streams and, in fast replays, with the following frames
+    void setBatchedInference(bool batched) { batched_inference = batched; };
 
     enum ViewMode { BIRDEYE, EYELEVEL, };
     void setViewMode(ViewMode m) {viewMode = m; };
@@ -29,11 +53,14 @@ protected:
 
 signals:
     void frameCaptured(cv::Mat *data);
-    void photoTaken(QString name);
+    void photoTaken(QString name, QImage thumbnail);
 
 private:
     void takePhoto(cv::Mat &frame);
+    bool burstShotDue();
     void detectObjectsDNN(cv::Mat &frame);
+    void detectObjectsBatched(cv::Mat &frame, qint64 ticket);
+    void showCars(cv::Mat &frame, const vector<cv::Mat> &outs);
 
 private:
     bool running;
@@ -43,12 +70,30 @@ private:
     cv::Mat frame;
 
     int frame_width, frame_height;
+    ReplayMode replay_mode;
 
     // take photos
     bool taking_photo;
+    PhotoEncoder *encoder;
+
+    // burst requested by the GUI thread, picked up by the capture loop
+    int burst_count;
+    int burst_interval_ms;
+    bool burst_requested, burst_stop_requested;
+    // burst in progress, burst_left is -1 for a continuous one
+    int burst_left;
+    QElapsedTimer burst_clock;
+    qint64 next_shot_ms;
 
     cv::dnn::Net net;
     vector<string> objectClasses;
+    YoloDecoder decoder;
+
+    // batched inference, frames wait here with their ticket until their result is back
+    bool batched_inference;
+    BatchScheduler *batch_scheduler;
+    QQueue<QPair<cv::Mat, qint64>> batch_frames;
+    int batch_depth;
 
     ViewMode viewMode;
 };
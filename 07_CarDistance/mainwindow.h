@@ -30,13 +30,21 @@ private:
     void initUI();
     void createActions();
     void populateSavedList();
+    void startCapture(CaptureThread *thread, QString status);
 
 private slots:
     void showCameraInfo();
     void openCamera();
+    void openVideo();
+    void openStream();
     void updateFrame(cv::Mat*);
     void takePhoto();
-    void appendSavedPhoto(QString name);
+    void appendSavedPhoto(QString name, QImage thumbnail);
+    void takeBurst();
+    void toggleContinuousPhotos(bool on);
+    void changeBurstSettings();
+    void modelLoadProgress(int loaded, int total, QString name);
+    void modelLoadFailed(QString error);
     void changeViewMode();
 
 private:
@@ -44,6 +52,11 @@ private:
 
     QAction *cameraInfoAction;
     QAction *openCameraAction;
+    QAction *openVideoAction;
+    QAction *openStreamAction;
+    QAction *fastReplayAction;
+    QAction *batchedInferenceAction;
+    QAction *burstSettingsAction;
     QAction *exitAction;
 
     QMenu *viewMenu;
@@ -55,6 +68,13 @@ private:
     QGraphicsView *imageView;
 
     QPushButton *shutterButton;
+    QPushButton *burstButton;
+    QPushButton *continuousButton;
+
+    // burst photos, a rate of 0 takes every frame
+    int burst_count;
+    double burst_rate;
+    double continuous_rate;
 
     QListView *saved_list;
     QStandardItemModel *list_model;
@@ -3,6 +3,7 @@
 #include <QDateTime>
 #include <QDir>
 #include <QStandardPaths>
+#include <QMutex>
 #include <QDebug>
 
 #include "utilities.h"
@@ -18,7 +19,20 @@ QString Utilities::getDataPath()
 QString Utilities::newPhotoName()
 {
     QDateTime time = QDateTime::currentDateTime();
-    return time.toString("yyyy-MM-dd+HH:mm:ss");
+    QString name = time.toString("yyyy-MM-dd+HH:mm:ss.zzz");
+
+    // photos of a burst taken within the same millisecond get a sequence number
+    static QMutex lock;
+    static QString last_name;
+    static int sequence = 0;
+    QMutexLocker locker(&lock);
+    if (name == last_name)
+    {
+        return QString("%1-%2").arg(name).arg(++sequence);
+    }
+    last_name = name;
+    sequence = 0;
+    return name;
 }
 
 QString Utilities::getPhotoPath(QString name, QString postfix)